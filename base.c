@@ -2,6 +2,9 @@
 #define FLOS_BASE
 
 #include <float.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #ifdef __EMSCRIPTEN__
 #include <emscripten.h>
@@ -35,6 +38,12 @@ typedef versors quats;
 #ifndef FLOS_UTILS
 #include "utils.c"
 
+#ifndef FLOS_PROFILE_ZONES
+#include "profile.c"
+
+#ifndef FLOS_JOBS
+#include "jobs.c"
+
 #ifndef FLOS_WINDOW
 #include "window.c"
 
@@ -50,12 +59,30 @@ typedef versors quats;
 #ifndef FLOS_ENTITY
 #include "entity.c"
 
+#ifndef FLOS_TRANSFORM_BATCH
+#include "transform_batch.c"
+
 #ifndef FLOS_SCENE
 #include "scene.c"
 
+#ifndef FLOS_CULL
+#include "cull.c"
+
+#ifndef FLOS_RENDER_NULL
+#include "render_null.c"
+
+#ifndef FLOS_SHADERS
+#include "shaders.c"
+
+#ifndef FLOS_RENDER_QUEUE
+#include "render_queue.c"
+
 #ifndef FLOS_RENDER
 #include "render.c"
 
+#ifndef FLOS_TERRAIN
+#include "terrain.c"
+
 #ifndef FLOS_UI
 #include "ui.c"
 
@@ -73,5 +100,13 @@ typedef versors quats;
 #endif
 #endif
 #endif
+#endif
+#endif
+#endif
+#endif
+#endif
+#endif
+#endif
+#endif
 
 #endif // FLOS_BASE
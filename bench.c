@@ -0,0 +1,650 @@
+#define FLOS_BENCH
+#include "base.c"
+
+// headless benchmarks, only built into flos_headless. every mode prints a
+// single json object to stdout so runs can be diffed across commits
+
+typedef enum {
+    BP_UpdatePlayer,
+    BP_UpdatePhysics,
+    BP_UpdateTerrain,
+    BP_UpdateTransforms,
+    BP_GatherInstances,
+    BP_CullInstances,
+    BP_BuildAtmosphere,
+    BP_BuildQueue,
+    BP_SubmitQueue,
+    BP_BumpReset,
+    BP_Frame,
+
+    BP_COUNT
+} BenchPhase;
+
+cstr bench_phase_names[BP_COUNT] = {
+    [BP_UpdatePlayer] = "game_update_player",
+    [BP_UpdatePhysics] = "game_update_physics",
+    [BP_UpdateTerrain] = "terrain_update",
+    [BP_UpdateTransforms] = "scene_update_transforms",
+    [BP_GatherInstances] = "render_gather_instances",
+    [BP_CullInstances] = "render_cull_instances",
+    [BP_BuildAtmosphere] = "render_build_atmosphere",
+    [BP_BuildQueue] = "render_build_queue",
+    [BP_SubmitQueue] = "render_submit_queue",
+    [BP_BumpReset] = "mrw_bump_reset",
+    [BP_Frame] = "frame",
+};
+
+STRUCT(BenchConfig) {
+    u32 n_frames;
+    f32 dt;
+    u64 seed;
+};
+
+static i32 bench_compare_f64(const void* a, const void* b) {
+    f64 x = *(const f64*)a;
+    f64 y = *(const f64*)b;
+    return (x > y) - (x < y);
+}
+
+// expects sorted samples
+static f64 bench_percentile(f64* samples, u32 n, f64 p) {
+    if (n == 0) return 0.0;
+    u32 i = (u32)(p * (f64)(n - 1) + 0.5);
+    return samples[min(i, n - 1)];
+}
+
+static void bench_print_samples(cstr name, f64* samples, u32 n, bool last) {
+    f64 total = 0.0;
+    for (u32 i = 0; i < n; i++) total += samples[i];
+    qsort(samples, n, sizeof(f64), bench_compare_f64);
+
+    printf("    \"%s\": { \"mean_us\": %.3f, \"p50_us\": %.3f, \"p95_us\": %.3f, \"p99_us\": %.3f, \"max_us\": %.3f }%s\n",
+        name,
+        n ? total / n * 1e6 : 0.0,
+        bench_percentile(samples, n, 0.50) * 1e6,
+        bench_percentile(samples, n, 0.95) * 1e6,
+        bench_percentile(samples, n, 0.99) * 1e6,
+        n ? samples[n - 1] * 1e6 : 0.0,
+        last ? "" : ",");
+}
+
+// runs the same phases as game_on_frame but at a fixed dt and without the
+// render submit, timing each one separately
+void bench_frames(BenchConfig config) {
+    Scene* scene = game.current_scene;
+    game.dt = config.dt;
+
+    f64* samples[BP_COUNT];
+    for (u32 p = 0; p < BP_COUNT; p++) {
+        samples[p] = mrw_alloc_n(memory.stable, f64, max(config.n_frames, 1u));
+    }
+    f64* uploaded = mrw_alloc_n(memory.stable, f64, max(config.n_frames, 1u));
+    u64 n_tested = 0, n_visible = 0, n_horizon_tested = 0, n_horizon_culled = 0;
+    u64 n_packets = 0, n_shader_switches = 0, n_binding_switches = 0;
+
+    for (u32 frame = 0; frame < config.n_frames; frame++) {
+        f64 frame_start = time_now();
+        f64 t;
+
+        RIPPLE(
+            FORM(.width = PERCENT(1.0f, SVT_RELATIVE_CHILD), .height = PERCENT(1.0f, SVT_RELATIVE_CHILD)),
+            RECTANGLE(.color = RIPPLE_RGBA(0x2e2e2ebf), .radiusBR = .15f))
+        {
+            t = time_now();
+            game_update_player(scene);
+            samples[BP_UpdatePlayer][frame] = time_now() - t;
+
+            t = time_now();
+            game_update_physics(scene);
+            samples[BP_UpdatePhysics][frame] = time_now() - t;
+
+            t = time_now();
+            terrain_update(&game.terrain, scene, scene->camera);
+            samples[BP_UpdateTerrain][frame] = time_now() - t;
+
+            window_update_input(memory.frame);
+        }
+
+        t = time_now();
+        scene_update_transforms(scene);
+        samples[BP_UpdateTransforms][frame] = time_now() - t;
+
+        render_null_begin_frame();
+        render_prepare(scene);
+
+        t = time_now();
+        render_gather_instances(scene);
+        samples[BP_GatherInstances][frame] = time_now() - t;
+        n_horizon_tested += renderer.cull.stats.n_horizon_tested;
+        n_horizon_culled += renderer.cull.stats.n_horizon_culled;
+
+        render_upload_instances();
+
+        t = time_now();
+        render_cull_instances();
+        samples[BP_CullInstances][frame] = time_now() - t;
+        n_tested += renderer.cull.stats.n_tested;
+        n_visible += renderer.cull.stats.n_visible;
+
+        t = time_now();
+        render_build_atmosphere(scene);
+        samples[BP_BuildAtmosphere][frame] = time_now() - t;
+
+        t = time_now();
+        render_build_queue();
+        samples[BP_BuildQueue][frame] = time_now() - t;
+
+        t = time_now();
+        render_render_meshes();
+        render_render_atmosphere();
+        samples[BP_SubmitQueue][frame] = time_now() - t;
+        n_packets += renderer.queue.stats.n_packets;
+        n_shader_switches += renderer.queue.stats.n_shader_switches;
+        n_binding_switches += renderer.queue.stats.n_binding_switches;
+
+        scene_end_frame(scene);
+
+        t = time_now();
+        mrw_bump_reset(&memory._frame);
+        samples[BP_BumpReset][frame] = time_now() - t;
+
+        samples[BP_Frame][frame] = time_now() - frame_start;
+        uploaded[frame] = (f64)render_null.frame.n_bytes_uploaded;
+    }
+
+    // the first frame uploads every instance, after that only what changed
+    f64 uploaded_total = 0.0, uploaded_max = 0.0;
+    for (u32 frame = 1; frame < config.n_frames; frame++) {
+        uploaded_total += uploaded[frame];
+        uploaded_max = max(uploaded_max, uploaded[frame]);
+    }
+
+    printf("{\n");
+    printf("  \"bench\": \"frames\",\n");
+    printf("  \"frames\": %u,\n", config.n_frames);
+    printf("  \"dt\": %.6f,\n", config.dt);
+    printf("  \"seed\": %llu,\n", (unsigned long long)config.seed);
+    printf("  \"phases\": {\n");
+    for (u32 p = 0; p < BP_COUNT; p++) {
+        bench_print_samples(bench_phase_names[p], samples[p], config.n_frames, p == BP_COUNT - 1);
+    }
+    printf("  },\n");
+    printf("  \"upload_bytes\": { \"first\": %.0f, \"mean\": %.1f, \"max\": %.0f },\n",
+        config.n_frames ? uploaded[0] : 0.0,
+        config.n_frames > 1 ? uploaded_total / (config.n_frames - 1) : 0.0,
+        uploaded_max);
+    f64 frames = config.n_frames ? (f64)config.n_frames : 1.0;
+    printf("  \"cull\": { \"tested\": %.1f, \"visible\": %.1f, \"culled\": %.1f, \"horizon_tested\": %.1f, \"horizon_culled\": %.1f },\n",
+        (f64)n_tested / frames,
+        (f64)n_visible / frames,
+        (f64)(n_tested - n_visible) / frames,
+        (f64)n_horizon_tested / frames,
+        (f64)n_horizon_culled / frames);
+    printf("  \"queue\": { \"packets\": %.1f, \"shader_switches\": %.1f, \"binding_switches\": %.1f }\n",
+        (f64)n_packets / frames,
+        (f64)n_shader_switches / frames,
+        (f64)n_binding_switches / frames);
+    printf("}\n");
+}
+
+static quats bench_random_rot(Rng* rng) {
+    vec3s axis = vec3_normalize((vec3s){ .x = rng_f32(rng, -1.0f, 1.0f), .y = rng_f32(rng, -1.0f, 1.0f), .z = rng_f32(rng, 0.1f, 1.0f) });
+    return glms_quatv(rng_f32(rng, -M_PI, M_PI), axis);
+}
+
+// transform_world_scalar vs transform_world_batch on a synthetic column: a
+// handful of roots and n children spread over them, like plants on planets
+void bench_transforms(u64 seed) {
+    u32 sizes[] = { 10000, 100000, 1000000 };
+    u32 n_roots = 64;
+    u32 n_max = sizes[array_len(sizes) - 1];
+
+    Rng rng = rng_seeded(seed);
+    struct TransformC* transforms = mrw_alloc_n(memory.stable, struct TransformC, n_roots + n_max);
+    struct TransformC* reference = mrw_alloc_n(memory.stable, struct TransformC, n_roots + n_max);
+    u32* indices = mrw_alloc_n(memory.stable, u32, n_max);
+    u32* parents = mrw_alloc_n(memory.stable, u32, n_max);
+
+    for (u32 i = 0; i < n_roots + n_max; i++) {
+        struct Transform t = {
+            .pos = { .x = rng_f32(&rng, -10.0f, 10.0f), .y = rng_f32(&rng, -10.0f, 10.0f), .z = rng_f32(&rng, -10.0f, 10.0f) },
+            .rot = bench_random_rot(&rng),
+            .scale = rng_f32(&rng, 0.5f, 2.0f),
+        };
+        transforms[i] = (struct TransformC){ .local = t, .world = t };
+    }
+    for (u32 i = 0; i < n_max; i++) {
+        indices[i] = n_roots + i;
+        parents[i] = rng_u32(&rng) % n_roots;
+    }
+
+    printf("{\n");
+    printf("  \"bench\": \"transforms\",\n");
+    printf("  \"simd\": %s,\n",
+    #ifdef TRANSFORM_BATCH_SIMD
+        "true"
+    #else
+        "false"
+    #endif
+    );
+    printf("  \"sizes\": [\n");
+
+    for (u32 s = 0; s < array_len(sizes); s++) {
+        u32 n = sizes[s];
+        u32 reps = max(10000000u / n, 1u);
+
+        f64 t = time_now();
+        for (u32 r = 0; r < reps; r++) transform_world_scalar(transforms, indices, parents, n);
+        f64 scalar = (time_now() - t) / reps;
+        buf_copy(reference, transforms, sizeof(struct TransformC) * (n_roots + n));
+
+        t = time_now();
+        for (u32 r = 0; r < reps; r++) transform_world_batch(transforms, indices, parents, n);
+        f64 batch = (time_now() - t) / reps;
+
+        f32 max_error = 0.0f;
+        for (u32 i = n_roots; i < n_roots + n; i++) {
+            for (u32 c = 0; c < 4; c++) {
+                for (u32 k = 0; k < 4; k++) {
+                    max_error = max(max_error, fabsf(transforms[i]._matrix.col[c].raw[k] - reference[i]._matrix.col[c].raw[k]));
+                }
+            }
+        }
+
+        printf("    { \"n\": %u, \"reps\": %u, \"scalar_ns_per_entity\": %.3f, \"batch_ns_per_entity\": %.3f, \"speedup\": %.2f, \"max_matrix_error\": %g }%s\n",
+            n, reps,
+            scalar * 1e9 / n,
+            batch * 1e9 / n,
+            batch > 0.0 ? scalar / batch : 0.0,
+            max_error,
+            s + 1 < array_len(sizes) ? "," : "");
+    }
+
+    printf("  ]\n");
+    printf("}\n");
+}
+
+// cull_instances_scalar vs cull_instances over plant sized instances spread
+// around a camera at the origin, a quarter of a slot column left free
+void bench_cull(u64 seed) {
+    u32 sizes[] = { 10000, 100000, 1000000 };
+    u32 n_max = sizes[array_len(sizes) - 1];
+
+    Rng rng = rng_seeded(seed);
+    Instance* instances = mrw_alloc_n(memory.stable, Instance, n_max);
+    u32* visible = mrw_alloc_n(memory.stable, u32, n_max);
+    u32* reference = mrw_alloc_n(memory.stable, u32, n_max);
+
+    for (u32 i = 0; i < n_max; i++) {
+        if (rng_u32(&rng) % 4 == 0) {
+            instances[i] = (Instance){ 0 };
+            continue;
+        }
+        struct Transform t = {
+            .pos = { .x = rng_f32(&rng, -100.0f, 100.0f), .y = rng_f32(&rng, -100.0f, 100.0f), .z = rng_f32(&rng, -100.0f, 100.0f) },
+            .rot = bench_random_rot(&rng),
+            .scale = rng_f32(&rng, 0.5f, 2.0f),
+        };
+        instances[i].mat = mat4_from_transform(&t);
+    }
+
+    mat4s camera = glms_perspective(to_rad(RENDER_FOV), 16.0f / 9.0f, 0.01f, 1000.0f);
+    Frustum frustum = frustum_from_matrix(camera.raw);
+    vec4s bound = { .x = 0.0f, .y = PLANT_HEIGHT * 0.5f, .z = 0.0f, .w = PLANT_HEIGHT * 0.5f };
+
+    printf("{\n");
+    printf("  \"bench\": \"cull\",\n");
+    printf("  \"simd\": %s,\n",
+    #ifdef CULL_SIMD
+        "true"
+    #else
+        "false"
+    #endif
+    );
+    printf("  \"sizes\": [\n");
+
+    for (u32 s = 0; s < array_len(sizes); s++) {
+        u32 n = sizes[s];
+        u32 reps = max(10000000u / n, 1u);
+
+        u32 n_reference = 0;
+        f64 t = time_now();
+        for (u32 r = 0; r < reps; r++) n_reference = cull_instances_scalar(&frustum, (u8*)instances, sizeof(Instance), 0, n, bound, 0.0f, reference);
+        f64 scalar = (time_now() - t) / reps;
+
+        u32 n_visible = 0;
+        t = time_now();
+        for (u32 r = 0; r < reps; r++) n_visible = cull_instances(&frustum, (u8*)instances, sizeof(Instance), n, bound, 0.0f, visible);
+        f64 simd = (time_now() - t) / reps;
+
+        bool matches = n_visible == n_reference && memcmp(visible, reference, n_visible * sizeof(u32)) == 0;
+
+        printf("    { \"n\": %u, \"reps\": %u, \"visible\": %u, \"scalar_ns_per_instance\": %.3f, \"simd_ns_per_instance\": %.3f, \"speedup\": %.2f, \"matches\": %s }%s\n",
+            n, reps, n_visible,
+            scalar * 1e9 / n,
+            simd * 1e9 / n,
+            simd > 0.0 ? scalar / simd : 0.0,
+            matches ? "true" : "false",
+            s + 1 < array_len(sizes) ? "," : "");
+    }
+
+    printf("  ]\n");
+    printf("}\n");
+}
+
+// the generator planet.c had before the edge cache, three fresh midpoint
+// vertices per triangle and u16 indices. kept here only to compare against
+static usize bench_icosphere_legacy(u32 subdivisions, Allocator* allocator) {
+    usize n_indices = array_len(icosahedron_indices);
+    usize n_vertices = array_len(icosahedron_vertices);
+    for (u32 i = 0; i < subdivisions; i++) {
+        n_vertices += n_indices;
+        n_indices *= 4;
+    }
+    Vertex* vertices = mrw_alloc_n(allocator, Vertex, n_vertices);
+    u16* indices = mrw_alloc_n(allocator, u16, n_indices);
+    buf_copy(vertices, icosahedron_vertices, sizeof(icosahedron_vertices));
+    buf_copy(indices, icosahedron_indices, sizeof(icosahedron_indices));
+
+    usize n_v = array_len(icosahedron_vertices);
+    usize n_i = array_len(icosahedron_indices);
+    for (u32 s = 0; s < subdivisions; s++) {
+        usize n = n_i;
+        for (usize i = 0; i < n; i += 3) {
+            u16 i1 = indices[i + 0], i3 = indices[i + 1], i5 = indices[i + 2];
+            u16 i2 = (u16)n_v, i4 = (u16)(n_v + 1), i6 = (u16)(n_v + 2);
+            vertices[n_v++] = (Vertex){ .position = vec3_scale(vec3_add(vertices[i1].position, vertices[i3].position), 0.5f) };
+            vertices[n_v++] = (Vertex){ .position = vec3_scale(vec3_add(vertices[i3].position, vertices[i5].position), 0.5f) };
+            vertices[n_v++] = (Vertex){ .position = vec3_scale(vec3_add(vertices[i5].position, vertices[i1].position), 0.5f) };
+
+            indices[i + 1] = i2;
+            indices[i + 2] = i6;
+            u16 rest[] = { i2, i3, i4, i4, i5, i6, i6, i2, i4 };
+            buf_copy(indices + n_i, rest, sizeof(rest));
+            n_i += array_len(rest);
+        }
+    }
+
+    for (usize i = 0; i < n_v; i++) {
+        vertices[i].position = vertices[i].normal = vec3_normalize(vertices[i].position);
+    }
+    return n_v;
+}
+
+// generation time and size per level, old generator vs planet_lod_table. the
+// old one overflows u16 past level 5 so it stops there
+void bench_icosphere(void) {
+    u32 legacy_max_level = 5;
+
+    printf("{\n");
+    printf("  \"bench\": \"icosphere\",\n");
+    printf("  \"levels\": [\n");
+
+    for (u32 level = 0; level <= PLANET_MAX_LEVEL; level++) {
+        u32 reps = max(1u << (2 * (PLANET_MAX_LEVEL - level)), 4u);
+
+        f64 t = time_now();
+        PlanetMesh mesh = { 0 };
+        for (u32 r = 0; r < reps; r++) {
+            mrw_bump_reset(&memory._frame);
+            mesh = planet_meshify(level, memory.frame);
+        }
+        f64 indexed = (time_now() - t) / reps;
+        usize n_vertices = slice_count(mesh.vertices);
+        usize n_indices = slice_count(mesh.indices);
+
+        f64 legacy = 0.0;
+        usize n_legacy_vertices = 0;
+        if (level <= legacy_max_level) {
+            t = time_now();
+            for (u32 r = 0; r < reps; r++) {
+                mrw_bump_reset(&memory._frame);
+                n_legacy_vertices = bench_icosphere_legacy(level, memory.frame);
+            }
+            legacy = (time_now() - t) / reps;
+        }
+        mrw_bump_reset(&memory._frame);
+
+        printf("    { \"level\": %u, \"vertices\": %zu, \"indices\": %zu, \"bytes\": %zu, \"indexed_ms\": %.4f",
+            level, n_vertices, n_indices,
+            n_vertices * sizeof(Vertex) + n_indices * sizeof(u16),
+            indexed * 1e3);
+        if (level <= legacy_max_level) {
+            printf(", \"legacy_vertices\": %zu, \"legacy_bytes\": %zu, \"legacy_ms\": %.4f",
+                n_legacy_vertices,
+                n_legacy_vertices * sizeof(Vertex) + n_indices * sizeof(u16),
+                legacy * 1e3);
+        }
+        printf(" }%s\n", level < PLANET_MAX_LEVEL ? "," : "");
+    }
+
+    printf("  ]\n");
+    printf("}\n");
+}
+
+// hashes every world transform and matrix, equal hashes mean bit identical results
+static u64 bench_hash_transforms(Scene* scene) {
+    return hash_bytes(HASH_INIT, scene_column(scene, transform), sizeof(struct TransformC) * scene->entities.n_slots);
+}
+
+// game_update_physics + scene_update_transforms over n bodies falling onto a
+// planet, each with a child, at 1/2/4/8 job threads. every run starts from the
+// same snapshot so the hashes at the end have to match. setup_ms is creating
+// the scene and its first transform pass, kept apart from the steps
+void bench_scaling(u64 seed) {
+    u32 n_bodies = 100000;
+    u32 n_steps = 60;
+    u32 thread_counts[] = { 1, 2, 4, 8 };
+
+    game.dt = 1.0f / 60.0f;
+
+    f64 setup_start = time_now();
+    Scene* scene = mrw_alloc(memory.stable, Scene);
+    scene_init(scene, n_bodies * 2 + 1, memory.stable);
+
+    Rng rng = rng_seeded(seed);
+    EntityHandle planet = scene_create_entity(scene, CT_Transform | CT_Planet,
+        .transform.world.scale = 10.0f,
+        .planet = { .gravity = -2.0f },
+    );
+    for (u32 i = 0; i < n_bodies; i++) {
+        vec3s up = vec3_normalize((vec3s){ .x = rng_f32(&rng, -1.0f, 1.0f), .y = rng_f32(&rng, -1.0f, 1.0f), .z = rng_f32(&rng, -1.0f, 1.0f) });
+        EntityHandle body = scene_create_entity(scene, CT_Transform | CT_Physics,
+            .transform.world = {
+                .pos = vec3_scale(up, rng_f32(&rng, 10.0f, 12.0f)),
+                .rot = quat_from_vecs(GLMS_YUP, up),
+            },
+            .physics = {
+                .vel = { .x = rng_f32(&rng, -1.0f, 1.0f), .z = rng_f32(&rng, -1.0f, 1.0f) },
+                .planet = planet,
+            },
+        );
+        scene_create_entity(scene, CT_Transform,
+            .parent = body,
+            .transform.local = { .pos = { .y = 0.3f }, .scale = 1.0f },
+        );
+    }
+    scene_update_transforms(scene);
+    mrw_bump_reset(&memory._frame);
+    f64 setup_ms = (time_now() - setup_start) * 1e3;
+
+    u32 n_slots = scene->entities.n_slots;
+    struct TransformC* transforms = mrw_alloc_n(memory.stable, struct TransformC, n_slots);
+    struct PhysicsC* physics = mrw_alloc_n(memory.stable, struct PhysicsC, n_slots);
+    buf_copy(transforms, scene_column(scene, transform), sizeof(struct TransformC) * n_slots);
+    buf_copy(physics, scene_column(scene, physics), sizeof(struct PhysicsC) * n_slots);
+
+    u32 n_runs = array_len(thread_counts);
+    f64 step_ms[array_len(thread_counts)];
+    u64 hashes[array_len(thread_counts)];
+
+    jobs_shutdown();
+    for (u32 r = 0; r < n_runs; r++) {
+        buf_copy(scene_column(scene, transform), transforms, sizeof(struct TransformC) * n_slots);
+        buf_copy(scene_column(scene, physics), physics, sizeof(struct PhysicsC) * n_slots);
+
+        jobs_init(thread_counts[r]);
+        f64 t = time_now();
+        for (u32 step = 0; step < n_steps; step++) {
+            game_update_physics(scene);
+            scene_update_transforms(scene);
+            mrw_bump_reset(&memory._frame);
+        }
+        step_ms[r] = (time_now() - t) * 1e3 / n_steps;
+        jobs_shutdown();
+
+        hashes[r] = bench_hash_transforms(scene);
+    }
+    jobs_init(0);
+
+    bool deterministic = true;
+    for (u32 r = 1; r < n_runs; r++) deterministic &= hashes[r] == hashes[0];
+
+    printf("{\n");
+    printf("  \"bench\": \"scaling\",\n");
+    printf("  \"bodies\": %u,\n", n_bodies);
+    printf("  \"steps\": %u,\n", n_steps);
+    printf("  \"setup_ms\": %.4f,\n", setup_ms);
+    printf("  \"deterministic\": %s,\n", deterministic ? "true" : "false");
+    printf("  \"threads\": [\n");
+    for (u32 r = 0; r < n_runs; r++) {
+        printf("    { \"threads\": %u, \"step_ms\": %.4f, \"speedup\": %.2f, \"hash\": \"%016llx\" }%s\n",
+            thread_counts[r], step_ms[r],
+            step_ms[r] > 0.0 ? step_ms[0] / step_ms[r] : 0.0,
+            (unsigned long long)hashes[r],
+            r + 1 < n_runs ? "," : "");
+    }
+    printf("  ]\n");
+    printf("}\n");
+}
+
+static void bench_lsystem_config(cstr path, u32 first, u32 last, u32 n_seeds, bool last_config) {
+    PlantConfig config = plant_parse_config(json_parse(file_read(path, memory.stable)), memory.stable);
+
+    PlantExpansion expansion;
+    plant_expansion_init(&expansion, 1024, memory.stable);
+    BumpAllocator programs = { MRW_BUMP_IMPL };
+
+    printf("    \"%s\": [\n", path);
+    for (u32 iterations = first; iterations <= last; iterations++) {
+        config.iterations = iterations;
+        u32 reps = max(1u << (2 * (last - iterations)), 2u);
+
+        u8Slice symbols = { 0 };
+        f64 t = time_now();
+        for (u32 r = 0; r < reps; r++) symbols = plant_expand(&expansion, &config);
+        f64 expand = (time_now() - t) / reps;
+
+        PlantProgram program = { 0 };
+        t = time_now();
+        for (u32 r = 0; r < reps; r++) {
+            mrw_bump_reset(&programs);
+            program = plant_compile(&config, symbols, (Allocator*)&programs);
+        }
+        f64 compile = (time_now() - t) / reps;
+
+        // one plant per seed, off the same program
+        PlantTemplate plant = { 0 };
+        u32 n_evaluated = max(n_seeds >> (iterations - first), 1u);
+        t = time_now();
+        for (u32 seed = 0; seed < n_evaluated; seed++) {
+            mrw_bump_reset(&memory._frame);
+            plant = plant_evaluate(&config, &program, seed, memory.frame);
+        }
+        f64 evaluate = (time_now() - t) / n_evaluated;
+        mrw_bump_reset(&memory._frame);
+
+        usize n_symbols = slice_count(symbols);
+        printf("      { \"iterations\": %u, \"symbols\": %zu, \"ops\": %u, \"shapes\": %u, \"expand_ms\": %.4f, \"compile_ms\": %.4f, \"evaluate_us_per_plant\": %.3f, \"msymbols_per_s\": %.1f }%s\n",
+            iterations, n_symbols, program.n_ops, plant.n_shapes,
+            expand * 1e3, compile * 1e3, evaluate * 1e6,
+            expand > 0.0 ? n_symbols / expand * 1e-6 : 0.0,
+            iterations < last ? "," : "");
+    }
+    printf("    ]%s\n", last_config ? "" : ",");
+
+    mrw_bump_reset(&programs);
+    plant_expansion_free(&expansion);
+}
+
+// expansion, compile and per plant evaluation for both plant configs.
+// expansion and compile run once per config at startup, evaluate once per plant
+void bench_lsystem(void) {
+    printf("{\n");
+    printf("  \"bench\": \"lsystem\",\n");
+    printf("  \"configs\": {\n");
+    bench_lsystem_config("./res/plant.json", 6, 10, 64, false);
+    bench_lsystem_config("./res/system.json", 6, 12, 1024, true);
+    printf("  },\n");
+
+    // startup cost of the game's plant library, built from scratch and read back from the disk cache
+    PlantConfig config = plant_parse_config(json_parse(file_read("./res/plant.json", memory.stable)), memory.stable);
+
+    f64 t = time_now();
+    PlantLibrary library = plant_library(&config, PLANT_VARIANTS, 0, false, memory.frame);
+    f64 cold = time_now() - t;
+    mrw_bump_reset(&memory._frame);
+
+    plant_library(&config, PLANT_VARIANTS, 0, true, memory.frame);
+    mrw_bump_reset(&memory._frame);
+
+    t = time_now();
+    PlantLibrary warm_library = plant_library(&config, PLANT_VARIANTS, 0, true, memory.frame);
+    f64 warm = time_now() - t;
+    mrw_bump_reset(&memory._frame);
+
+    printf("  \"library\": { \"variants\": %u, \"shapes_per_variant\": %u, \"threads\": %u, \"cold_ms\": %.3f, \"cached_ms\": %.3f, \"cache_hit\": %s }\n",
+        library.n_variants, library.n_shapes, jobs_n_threads(),
+        cold * 1e3, warm * 1e3,
+        warm_library.cached ? "true" : "false");
+    printf("}\n");
+}
+
+// plant_meshify throughput on res/plant.json templates of growing size and
+// ring resolution, the bigger ones lose ring vertices and then shapes to fit
+// u16 indices
+void bench_plant_mesh(void) {
+    PlantConfig config = plant_parse_config(json_parse(file_read("./res/plant.json", memory.stable)), memory.stable);
+    u32 radials[] = { 3, 6, 12 };
+    u32 first = 6, last = 10;
+
+    printf("{\n");
+    printf("  \"bench\": \"plant_mesh\",\n");
+    printf("  \"meshes\": [\n");
+
+    for (u32 iterations = first; iterations <= last; iterations++) {
+        config.iterations = iterations;
+        BumpAllocator templates = { MRW_BUMP_IMPL };
+        PlantProgram program = plant_program(&config, (Allocator*)&templates);
+        PlantTemplate plant = plant_evaluate(&config, &program, 0, (Allocator*)&templates);
+        plant_normalize(&plant, PLANT_HEIGHT);
+
+        for (u32 r = 0; r < array_len(radials); r++) {
+            u32 radial = radials[r];
+            u32 reps = max(1u << (2 * (last - iterations)), 2u);
+
+            PlantMeshSize size = plant_mesh_size(&plant, radial);
+            PlantMesh mesh = { 0 };
+            f64 t = time_now();
+            for (u32 i = 0; i < reps; i++) {
+                mrw_bump_reset(&memory._frame);
+                mesh = plant_meshify(&plant, radial, memory.frame);
+            }
+            f64 elapsed = (time_now() - t) / reps;
+
+            usize n_vertices = slice_count(mesh.vertices);
+            bool last_line = iterations == last && r + 1 == array_len(radials);
+            printf("    { \"iterations\": %u, \"radial\": %u, \"meshed_radial\": %u, \"shapes\": %u, \"meshed_shapes\": %u, \"vertices\": %zu, \"indices\": %zu, \"ms\": %.4f, \"mvertices_per_s\": %.2f }%s\n",
+                iterations, radial, size.radial, plant.n_shapes, size.n_shapes,
+                n_vertices, slice_count(mesh.indices),
+                elapsed * 1e3,
+                elapsed > 0.0 ? n_vertices / elapsed * 1e-6 : 0.0,
+                last_line ? "" : ",");
+        }
+        mrw_bump_reset(&memory._frame);
+        mrw_bump_reset(&templates);
+    }
+
+    printf("  ]\n");
+    printf("}\n");
+}
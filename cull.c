@@ -0,0 +1,138 @@
+#define FLOS_CULL
+#include "base.c"
+
+// view frustum culling of instance bounding spheres. matrices are read
+// straight out of a mesh's instance mirror, stride bytes apart, and the slots
+// that survive are written out in order. 4 slots at a time when sse is
+// available
+//
+// free slots hold a zero matrix, its w of 0 marks them as never visible
+
+#if defined(__SSE2__) && !defined(FLOS_CULL_SCALAR)
+#include <immintrin.h>
+#define CULL_SIMD
+#endif
+
+// planes point inwards, p is inside one when dot(plane.xyz, p) + plane.w >= 0
+STRUCT(Frustum) {
+    vec4s planes[6];
+};
+
+// gribb/hartmann from a column major clip from world matrix. depth is 0..1
+// (CGLM_FORCE_DEPTH_ZERO_TO_ONE) so the near plane is row 2 alone
+Frustum frustum_from_matrix(mat4 m) {
+    vec4s rows[4];
+    for (u32 i = 0; i < 4; i++) {
+        rows[i] = (vec4s){ .x = m[0][i], .y = m[1][i], .z = m[2][i], .w = m[3][i] };
+    }
+
+    Frustum frustum = { .planes = {
+        vec4_add(rows[3], rows[0]),
+        vec4_sub(rows[3], rows[0]),
+        vec4_add(rows[3], rows[1]),
+        vec4_sub(rows[3], rows[1]),
+        rows[2],
+        vec4_sub(rows[3], rows[2]),
+    } };
+    for (u32 i = 0; i < 6; i++) {
+        vec4s p = frustum.planes[i];
+        f32 len = sqrtf(p.x * p.x + p.y * p.y + p.z * p.z);
+        frustum.planes[i] = vec4_scale(p, len > 0.0f ? 1.0f / len : 0.0f);
+    }
+    return frustum;
+}
+
+bool frustum_sphere(const Frustum* frustum, vec3s center, f32 radius) {
+    for (u32 i = 0; i < 6; i++) {
+        vec4s p = frustum->planes[i];
+        if (p.x * center.x + p.y * center.y + p.z * center.z + p.w < -radius) return false;
+    }
+    return true;
+}
+
+// bound is the mesh's sphere in its own space, xyz center and w radius.
+// the radius grows with the largest axis scale of the matrix, then by pad
+// world units for geometry the shader pushes out past the matrix
+u32 cull_instances_scalar(const Frustum* frustum, const u8* data, usize stride, u32 first, u32 n, vec4s bound, f32 pad, u32* visible) {
+    u32 n_visible = 0;
+    for (u32 i = first; i < first + n; i++) {
+        const f32* m = (const f32*)(data + i * stride);
+        if (m[15] == 0.0f) continue;
+
+        vec3s center = {
+            .x = m[0] * bound.x + m[4] * bound.y + m[8]  * bound.z + m[12],
+            .y = m[1] * bound.x + m[5] * bound.y + m[9]  * bound.z + m[13],
+            .z = m[2] * bound.x + m[6] * bound.y + m[10] * bound.z + m[14],
+        };
+        f32 scale = max(m[0] * m[0] + m[1] * m[1] + m[2] * m[2],
+                    max(m[4] * m[4] + m[5] * m[5] + m[6] * m[6],
+                        m[8] * m[8] + m[9] * m[9] + m[10] * m[10]));
+
+        if (frustum_sphere(frustum, center, bound.w * sqrtf(scale) + pad)) {
+            visible[n_visible++] = i;
+        }
+    }
+    return n_visible;
+}
+
+#ifdef CULL_SIMD
+
+u32 cull_instances(const Frustum* frustum, const u8* data, usize stride, u32 n, vec4s bound, f32 pad, u32* visible) {
+    __m128 bx = _mm_set1_ps(bound.x);
+    __m128 by = _mm_set1_ps(bound.y);
+    __m128 bz = _mm_set1_ps(bound.z);
+    __m128 br = _mm_set1_ps(bound.w);
+    __m128 bp = _mm_set1_ps(pad);
+    __m128 zero = _mm_setzero_ps();
+
+    u32 n_visible = 0;
+    u32 i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const f32* m0 = (const f32*)(data + (i + 0) * stride);
+        const f32* m1 = (const f32*)(data + (i + 1) * stride);
+        const f32* m2 = (const f32*)(data + (i + 2) * stride);
+        const f32* m3 = (const f32*)(data + (i + 3) * stride);
+        #define CULL_LANES(k) _mm_setr_ps(m0[k], m1[k], m2[k], m3[k])
+
+        __m128 c0x = CULL_LANES(0), c0y = CULL_LANES(1), c0z = CULL_LANES(2);
+        __m128 c1x = CULL_LANES(4), c1y = CULL_LANES(5), c1z = CULL_LANES(6);
+        __m128 c2x = CULL_LANES(8), c2y = CULL_LANES(9), c2z = CULL_LANES(10);
+        __m128 c3x = CULL_LANES(12), c3y = CULL_LANES(13), c3z = CULL_LANES(14), c3w = CULL_LANES(15);
+
+        #undef CULL_LANES
+
+        __m128 cx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0x, bx), _mm_mul_ps(c1x, by)), _mm_add_ps(_mm_mul_ps(c2x, bz), c3x));
+        __m128 cy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0y, bx), _mm_mul_ps(c1y, by)), _mm_add_ps(_mm_mul_ps(c2y, bz), c3y));
+        __m128 cz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0z, bx), _mm_mul_ps(c1z, by)), _mm_add_ps(_mm_mul_ps(c2z, bz), c3z));
+
+        __m128 s0 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0x, c0x), _mm_mul_ps(c0y, c0y)), _mm_mul_ps(c0z, c0z));
+        __m128 s1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c1x, c1x), _mm_mul_ps(c1y, c1y)), _mm_mul_ps(c1z, c1z));
+        __m128 s2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c2x, c2x), _mm_mul_ps(c2y, c2y)), _mm_mul_ps(c2z, c2z));
+        __m128 radius = _mm_add_ps(_mm_mul_ps(br, _mm_sqrt_ps(_mm_max_ps(s0, _mm_max_ps(s1, s2)))), bp);
+        __m128 neg_radius = _mm_sub_ps(zero, radius);
+
+        __m128 inside = _mm_cmpneq_ps(c3w, zero);
+        for (u32 p = 0; p < 6; p++) {
+            vec4s plane = frustum->planes[p];
+            __m128 d = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), cx), _mm_mul_ps(_mm_set1_ps(plane.y), cy)),
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), cz), _mm_set1_ps(plane.w)));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, neg_radius));
+        }
+
+        i32 mask = _mm_movemask_ps(inside);
+        for (u32 k = 0; k < 4; k++) {
+            if (mask & (1 << k)) visible[n_visible++] = i + k;
+        }
+    }
+
+    return n_visible + cull_instances_scalar(frustum, data, stride, i, n - i, bound, pad, visible + n_visible);
+}
+
+#else // CULL_SIMD
+
+u32 cull_instances(const Frustum* frustum, const u8* data, usize stride, u32 n, vec4s bound, f32 pad, u32* visible) {
+    return cull_instances_scalar(frustum, data, stride, 0, n, bound, pad, visible);
+}
+
+#endif // CULL_SIMD
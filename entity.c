@@ -14,63 +14,78 @@ typedef enum {
 } ComponentType;
 
 typedef struct Scene Scene;
+typedef struct Terrain Terrain;
+
+// how far terrain moves the ground above and below a planet's radius, as a
+// fraction of it. terrain_height always stays within 1 +- TERRAIN_AMPLITUDE
+#define TERRAIN_AMPLITUDE 0.08f
+
+// slot in the scene's component columns, only resolves while generation
+// matches the slot's current generation
+STRUCT(EntityHandle) {
+    u32 index;
+    u32 generation;
+    bool valid;
+};
 
-typedef GenarrHandle EntityHandle;
+struct Transform {
+    vec3s pos;
+    quats rot;
+    f32 scale;
+};
 
-STRUCT(Entity) {
-    str name;
-    Scene* scene;
-    EntityHandle parent, first_child, next_sibling;
+struct TransformC {
+    struct Transform local, world;
+    mat4s _matrix;
+};
 
-    ComponentType components;
+struct MeshC {
+    MeshHandle mesh;
+    // slot + 1 in the mesh's instance buffer, 0 while it has none. owned by the renderer
+    u32 instance;
+};
 
-    struct TransformC {
-        struct Transform {
-            vec3s pos;
-            quats rot;
-            f32 scale;
-        } local, world;
-        mat4s _matrix;
-    } transform;
-
-    struct MeshC {
-        MeshHandle mesh;
-    } mesh;
-
-    struct PhysicsC {
-        vec3s vel;
-        bool on_ground;
-        EntityHandle planet;
-    } physics;
-
-    struct PlayerC {
-        u8 _;
-    } player;
-
-    struct PlanetC {
-        f32 gravity;
-    } planet;
-
-    struct PlantC {
-        u8 _;
-    } plant;
-
-    struct CameraC {
-        f32 pitch;
-    } camera;
+struct PhysicsC {
+    vec3s vel;
+    bool on_ground;
+    EntityHandle planet;
 };
 
-void entity_enable_components(Entity* entity, ComponentType components) {
-    FLAG_SET(entity->components, components);
-}
+struct PlanetC {
+    f32 gravity;
+    // grass layers drawn over the surface when close up
+    u32 shells;
+    // nullptr for a plain sphere
+    Terrain* terrain;
 
-void entity_disable_components(Entity* entity, ComponentType components) {
-    FLAG_CLEAR(entity->components, components);
-}
+    // picked every frame by the renderer from the planet's size on screen
+    u32 lod_shells;
+    u32 lod_level;
+};
 
-bool entity_has(Entity* entity, ComponentType components) {
-    return FLAG_HAS_ALL(entity->components, components);
-}
+struct CameraC {
+    f32 pitch;
+};
+
+struct EntityLinks {
+    EntityHandle parent, first_child, next_sibling;
+};
+
+// everything an entity can be created with, scene_create_entity scatters it
+// into the scene's columns. player and plant are tags, they only live in the
+// components mask
+STRUCT(EntityDesc) {
+    str name;
+    EntityHandle parent;
+
+    ComponentType components;
+
+    struct TransformC transform;
+    struct MeshC mesh;
+    struct PhysicsC physics;
+    struct PlanetC planet;
+    struct CameraC camera;
+};
 
 mat4s mat4_from_transform(struct Transform* transform)
 {
@@ -81,3 +96,20 @@ mat4s mat4_from_transform(struct Transform* transform)
     mat.col[3] = (vec4s){ .x = transform->pos.x, .y = transform->pos.y, .z = transform->pos.z, .w = 1.0f };
     return mat;
 }
+
+struct Transform transform_calculate_world(struct Transform parent, struct Transform local) {
+    return (struct Transform){
+      .pos = vec3_add(parent.pos, quat_rotatev(parent.rot, vec3_scale(local.pos, parent.scale))),
+      .rot = quat_mul(parent.rot, local.rot),
+      .scale = parent.scale * local.scale,
+    };
+}
+
+struct Transform transform_calculate_local(struct Transform parent, struct Transform world) {
+    quats parent_inv_rot = quat_inv(parent.rot);
+    return (struct Transform){
+      .pos = vec3_scale(quat_rotatev(parent_inv_rot, vec3_sub(world.pos, parent.pos)), 1.0f / parent.scale),
+      .rot = quat_mul(parent_inv_rot, world.rot),
+      .scale = world.scale / parent.scale,
+    };
+}
@@ -8,29 +8,31 @@ struct {
     f32 avg_fps;
     u32 dt_n_samples;
 
-    PlantTemplate plant_templates[1];
+    PlantConfig plant_config;
 
     VEKTOR(Scene*) scenes;
     Scene* current_scene;
 
-    MeshHandle plant_mesh;
-    MeshHandle planet_mesh;
+    // one per variant in the plant library, plants pick one at random
+    MeshHandle plant_meshes[PLANT_VARIANTS];
+    // indexed by render lod, see planet_lod_subdivisions
+    MeshHandle planet_lods[PLANET_LOD_LEVELS];
     MeshHandle atmosphete_mesh;
+
+    Terrain terrain;
 } game = { 0 };
 
 Scene* game_new_scene(void) {
     Scene* scene = mrw_alloc(memory.stable, Scene);
     vektor_add(game.scenes, scene);
-    *scene = (Scene) { 0 };
-    genarr_init(scene->entities, 12, memory.stable);
+    scene_init(scene, 12, memory.stable);
     return scene;
 }
 
 void game_update_player(Scene* scene) {
-    Entity* entity = scene_get_entity(scene, scene->player);
-    struct PhysicsC* phys = &entity->physics;
+    struct PhysicsC* phys = entity_physics(scene, scene->player);
 
-    struct Transform* world = &entity->transform.world;
+    struct Transform* world = &entity_transform(scene, scene->player)->world;
 
     text(mrw_format("pos: {.2f} {.2f} {.2f}", memory.frame,
         world->pos.x,
@@ -38,9 +40,9 @@ void game_update_player(Scene* scene) {
         world->pos.z
     ));
 
-    Entity* planet = scene_get_entity(scene, phys->planet);
+    struct TransformC* planet = entity_transform(scene, phys->planet);
 
-    vec3s target_up = glms_normalize(vec3_sub(world->pos, planet->transform.world.pos));
+    vec3s target_up = glms_normalize(vec3_sub(world->pos, planet->world.pos));
     vec3s curr_up = quat_rotatev(world->rot, GLMS_YUP);
     vec3s up = glms_normalize(vec3_lerp(curr_up, target_up, 1.0f - expf(-10.0f * game.dt)));
 
@@ -64,25 +66,27 @@ void game_update_player(Scene* scene) {
     phys->vel.z = move_xz.z;
 
     // TODO: use entity_first_child_with
-    for_each_entity_children(entity, child)
+    for_each_entity_children(scene, scene->player, child)
     {
-        if (!entity_has(child, CT_Camera)) continue;
+        if (!entity_has(scene, child, CT_Camera)) continue;
 
-        struct Transform* local = &child->transform.local;
+        struct Transform* local = &entity_transform(scene, child)->local;
+        struct CameraC* camera = entity_camera(scene, child);
 
-        child->camera.pitch = clamp(child->camera.pitch + window.mouse.dy * 0.01, -M_PI * 0.5, M_PI * 0.5);
+        camera->pitch = clamp(camera->pitch + window.mouse.dy * 0.01, -M_PI * 0.5, M_PI * 0.5);
 
-        local->rot = quat_mul(glms_quatv(child->camera.pitch, GLMS_XUP), glms_quatv(M_PI, GLMS_YUP));
-        entity_transform_apply_local(child);
+        local->rot = quat_mul(glms_quatv(camera->pitch, GLMS_XUP), glms_quatv(M_PI, GLMS_YUP));
+        entity_transform_apply_local(scene, child);
 
         if (window.keys[KEY_PRESSED][KEY_M1]) {
-            struct Transform* world = &child->transform.world;
+            struct Transform* world = &entity_transform(scene, child)->world;
             vec3s forward = vec3_scale(quat_rotatev(world->rot, GLMS_ZUP), -1.0f);
             f32 t1, t2;
             f32 closest_dist = 99999.0f;
             EntityIter planet_iter = { .include = CT_Planet | CT_Transform };
+            PROFILE_ZONE("pick planet")
             while (scene_next_entity(scene, &planet_iter)) {
-                struct Transform planet_world = planet_iter.entity->transform.world;
+                struct Transform planet_world = scene_column(scene, transform)[planet_iter.index].world;
                 bool clicked = ray_sphere(world->pos, forward,
                     (vec4s){
                         .x = planet_world.pos.x,
@@ -104,42 +108,104 @@ void game_update_player(Scene* scene) {
     text(mrw_format("vely: {.3f}", memory.frame, phys->vel.y));
 }
 
-void game_update_physics(Scene* scene) {
-    EntityIter iter = { .include = CT_Physics | CT_Transform };
-    while(scene_next_entity(scene, &iter))
-    {
-        struct Transform* world = &iter.entity->transform.world;
-        struct PhysicsC* phys = &iter.entity->physics;
+// entities per physics job. fixed rather than derived from the thread count
+// so the split, and with it the result, is the same on any machine
+#define GAME_PHYSICS_BATCH 512
+
+STRUCT(GamePhysicsStep) {
+    Scene* scene;
+    u32* entities;
+    f32 dt;
+};
+
+// every entity only writes itself and reads its planet, which isn't moved by physics
+static void game_physics_integrate_job(void* data, u32 start, u32 end) {
+    GamePhysicsStep* step = data;
+    Scene* scene = step->scene;
+    struct TransformC* transforms = scene_column(scene, transform);
+    struct PhysicsC* physics = scene_column(scene, physics);
+
+    for (u32 i = start; i < end; i++) {
+        u32 index = step->entities[i];
+        struct Transform* world = &transforms[index].world;
+        struct PhysicsC* phys = &physics[index];
 
-        Entity* planet = scene_get_entity(scene, phys->planet);
+        struct TransformC* planet = entity_transform(scene, phys->planet);
+        f32 gravity = entity_planet(scene, phys->planet)->gravity;
 
         phys->vel.y = phys->on_ground ?
             max(phys->vel.y, 0.0f) :
-            (phys->vel.y + planet->planet.gravity * game.dt);
+            (phys->vel.y + gravity * step->dt);
 
         vec3s right   = vec3_scale(quat_rotatev(world->rot, GLMS_XUP), phys->vel.x);
         vec3s up      = vec3_scale(quat_rotatev(world->rot, GLMS_YUP), phys->vel.y);
         vec3s forward = vec3_scale(quat_rotatev(world->rot, GLMS_ZUP), phys->vel.z);
 
         vec3s vel  = vec3_add(right, vec3_add(up, forward));
-        world->pos = vec3_add(world->pos, vec3_scale(vel, game.dt));
+        world->pos = vec3_add(world->pos, vec3_scale(vel, step->dt));
 
-        vec3s to = vec3_sub(world->pos, planet->transform.world.pos);
+        vec3s to = vec3_sub(world->pos, planet->world.pos);
         f32 dist = vec3_norm(to);
-        phys->on_ground = dist < planet->transform.world.scale + 0.01f;
+        f32 ground = planet_ground_radius(scene, phys->planet, world->pos);
+        phys->on_ground = dist < ground + 0.01f;
         if (phys->on_ground && phys->vel.y < 0.0f) {
             world->pos = vec3_add(
-                planet->transform.world.pos,
-                vec3_scale(vec3_divs(to, dist), planet->transform.world.scale)
+                planet->world.pos,
+                vec3_scale(vec3_divs(to, dist), ground)
             );
         }
+    }
+}
+
+// runs once every world is final, only locals are written so parents can be read freely
+static void game_physics_rebase_job(void* data, u32 start, u32 end) {
+    GamePhysicsStep* step = data;
+    Scene* scene = step->scene;
+    struct TransformC* transforms = scene_column(scene, transform);
+    struct EntityLinks* links = scene_column(scene, links);
+
+    for (u32 i = start; i < end; i++) {
+        u32 index = step->entities[i];
+        struct TransformC* transform = &transforms[index];
+        struct TransformC* parent = entity_transform(scene, links[index].parent);
+        transform->local = parent ? transform_calculate_local(parent->world, transform->world) : transform->world;
+    }
+}
+
+void game_update_physics(Scene* scene) {
+    PROFILE_BEGIN("game_update_physics");
 
-        entity_transform_apply_world(iter.entity);
+    GamePhysicsStep step = { .scene = scene, .dt = game.dt };
+
+    u32 n = 0;
+    {
+        EntityIter iter = { .include = CT_Physics | CT_Transform };
+        while (scene_next_entity(scene, &iter)) n++;
+    }
+    step.entities = mrw_alloc_n(memory.frame, u32, max(n, 1u));
+    {
+        u32 i = 0;
+        EntityIter iter = { .include = CT_Physics | CT_Transform };
+        while (scene_next_entity(scene, &iter)) step.entities[i++] = iter.index;
+    }
+
+    JobCounter counter = { 0 };
+    jobs_parallel_for(&counter, "game_physics_integrate_job", n, GAME_PHYSICS_BATCH, game_physics_integrate_job, &step);
+    job_wait(&counter);
+    jobs_parallel_for(&counter, "game_physics_rebase_job", n, GAME_PHYSICS_BATCH, game_physics_rebase_job, &step);
+    job_wait(&counter);
+
+    for (u32 i = 0; i < n; i++) {
+        entity_transform_mark_dirty(scene, step.entities[i]);
     }
+
+    PROFILE_END();
 }
 
 void game_update(Scene* scene) {
     text(mrw_format("hello! you are running at {} fps.", memory.frame, game.avg_fps));
+    RenderCullStats* cull = &renderer.cull.stats;
+    text(mrw_format("instances: {} visible, {} culled", memory.frame, cull->n_visible, cull->n_tested - cull->n_visible));
 
     slider("planet stuff", &planet_grass_scale, 0.0001f, 0.01f, memory.frame);
 
@@ -147,14 +213,20 @@ void game_update(Scene* scene) {
     slider("atmo density", &renderer.shader_data.data.atmosphere_density, 0.0f, 2.0f, memory.frame);
     slider("atmo falloff", &renderer.shader_data.data.atmosphere_falloff, 1.0f, 50.0f, memory.frame);
 
-    if (slider("hello !", &branch, 0.0f, 2.0f, memory.frame)) {
-        PlantTemplate template = game.plant_templates[0] = plant_generate();
-        PlantMesh mesh = plant_meshify(&template, memory.frame);
-        render_mesh_re_create(game.plant_mesh, slice_u8(mesh.vertices), slice_u8(mesh.indices), sizeof(Instance), 0);
+    PlantShapeConfig* plant_shape = &game.plant_config.shapes[game.plant_config.first_shape];
+    if (slider("plant angle", &plant_shape->angle, 0.0f, 90.0f, memory.frame)) {
+        PROFILE_BEGIN("regenerate plants");
+        PlantLibrary library = plant_library(&game.plant_config, PLANT_VARIANTS, 0, false, memory.frame);
+        for (u32 v = 0; v < PLANT_VARIANTS; v++) {
+            PlantMesh mesh = library.meshes[v];
+            render_mesh_re_create(game.plant_meshes[v], slice_u8(mesh.vertices), slice_u8(mesh.indices), sizeof(Instance), shaders_find(str("plant")));
+        }
+        PROFILE_END();
     }
 
-    game_update_player(scene);
+    PROFILE_ZONE("game_update_player") game_update_player(scene);
     game_update_physics(scene);
+    terrain_update(&game.terrain, scene, scene->camera);
 }
 
 void game_init(void) {
@@ -162,42 +234,42 @@ void game_init(void) {
 
     // meshes
     {
-        FILE *fp = fopen("./res/plant.json", "rb");
-        fseek(fp, 0, SEEK_END);
-        usize size = ftell(fp);
-        rewind(fp);
-        char buf[size];
-        fread(buf, 1, size, fp);
-        fclose(fp);
-        str file_slice = array_slice(buf);
-        PlantConfig config = plant_parse_config(json_parse(file_slice));
-        mrw_unused config;
+        game.plant_config = plant_parse_config(json_parse(file_read("./res/plant.json", memory.frame)), memory.stable);
 
         {
-            PlantTemplate plant = game.plant_templates[0] = plant_generate();
-            PlantMesh mesh = plant_meshify(&plant, memory.frame);
-            game.plant_mesh = render_mesh_create(slice_u8(mesh.vertices), slice_u8(mesh.indices), sizeof(Instance), 0);
+            PlantLibrary library = plant_library(&game.plant_config, PLANT_VARIANTS, 0, true, memory.frame);
+            for (u32 v = 0; v < PLANT_VARIANTS; v++) {
+                PlantMesh mesh = library.meshes[v];
+                game.plant_meshes[v] = render_mesh_create(slice_u8(mesh.vertices), slice_u8(mesh.indices), sizeof(Instance), shaders_find(str("plant")));
+            }
         }
         {
-            PlanetMesh mesh = planet_meshify(memory.frame);
-            game.planet_mesh = render_mesh_create(slice_u8(mesh.vertices), slice_u8(mesh.indices), sizeof(PlanetInstance), 1);
+            PlanetLodTable table = planet_lod_table(planet_lod_subdivisions[PLANET_LOD_LEVELS - 1], memory.frame);
+            for (u32 lod = 0; lod < PLANET_LOD_LEVELS; lod++) {
+                PlanetMesh mesh = planet_lod_mesh(&table, planet_lod_subdivisions[lod], memory.frame);
+                game.planet_lods[lod] = render_mesh_create(slice_u8(mesh.vertices), slice_u8(mesh.indices), sizeof(PlanetInstance), shaders_find(str("planet")));
+            }
         }
+        render_set_planet_lods(game.planet_lods);
     }
 
+    // drawn through its terrain chunks, its mesh only holds the instance they
+    // share. the bound covers the highest the terrain goes
     EntityHandle planet = scene->planets[0] = scene_create_entity(scene, CT_Transform | CT_Mesh | CT_Planet,
         .name = sstr("planet"),
-        .mesh = { game.planet_mesh },
-        .planet.gravity = -2.0f,
+        .mesh = { render_mesh_create_instances((vec4s){ .w = 1.0f + TERRAIN_AMPLITUDE }, sizeof(PlanetInstance), shaders_find(str("planet"))) },
+        .planet = { .gravity = -2.0f, .shells = 16, .terrain = &game.terrain },
     );
+    terrain_init(&game.terrain, planet, rng_u32(&random_rng));
 
     scene->planets[1] = scene_create_entity(scene, CT_Transform | CT_Mesh | CT_Planet,
         .name = sstr("planet2"),
-        .mesh = { game.planet_mesh },
+        .mesh = { game.planet_lods[PLANET_LOD_LEVELS - 1] },
         .transform.world = {
             .pos = { .x = 20.0f, .y = 20.0f, .z = 20.0f },
             .scale = 10.0f,
         },
-        .planet.gravity = -4.0f,
+        .planet = { .gravity = -4.0f, .shells = 16 },
     );
 
     for (u32 i = 0; i < 1000; i++) {
@@ -207,11 +279,11 @@ void game_init(void) {
             .name = sstr("plant"),
             .parent = planet,
             .transform.world = {
-                .pos = vec3_scale(pos, 1.0f),
-                .scale = mrw_random_f32(1.0, 3.0) * 0.03,
-                .rot = quat_mul(glms_quatv(mrw_random_f32(-M_PI, M_PI), up), quat_from_vecs(GLMS_YUP, up)),
+                .pos = vec3_scale(pos, planet_ground_radius(scene, planet, pos)),
+                .scale = random_f32(1.0, 3.0) * 0.03,
+                .rot = quat_mul(glms_quatv(random_f32(-M_PI, M_PI), up), quat_from_vecs(GLMS_YUP, up)),
             },
-            .mesh = { game.plant_mesh },
+            .mesh = { game.plant_meshes[rng_u32(&random_rng) % PLANT_VARIANTS] },
         );
     }
 
@@ -246,12 +318,9 @@ static mat4s basis_from_up(vec3s up, vec3s hint) {
 }
 
 void game_on_frame(void *_) {
-    f32 time =
-    #ifdef __EMSCRIPTEN__
-        emscripten_get_now() * 0.001;
-    #else
-        glfwGetTime();
-    #endif
+    PROFILE_BEGIN("game_on_frame");
+
+    f32 time = time_now();
 
     game.dt = time - game.prev_time;
     game.dt_accum += game.dt;
@@ -272,11 +341,16 @@ void game_on_frame(void *_) {
             window.keys[KEY_PRESSED][KEY_M1] = false;
         }
 
-        game_update(game.current_scene);
+        PROFILE_ZONE("game_update") game_update(game.current_scene);
         window_update_input(memory.frame);
     }
 
-    render_render(game.current_scene);
+    scene_update_transforms(game.current_scene);
+
+    PROFILE_ZONE("render_render") render_render(game.current_scene);
+    scene_end_frame(game.current_scene);
+
+    PROFILE_ZONE("mrw_bump_reset") mrw_bump_reset(&memory._frame);
 
-    mrw_bump_reset(&memory._frame);
+    PROFILE_END();
 }
@@ -0,0 +1,131 @@
+#include "base.c"
+#include "bench.c"
+
+// headless entry point: same simulation as main.c, rendered through the null
+// backend in render_null.c so it runs without a window or gpu
+//
+// usage:
+//   flos_headless [frames]                 run the game loop, print averages
+//   flos_headless bench [frames] [seed]    fixed dt benchmark, json per-phase timings
+//   flos_headless bench-transforms [seed]  scalar vs batched world transform kernel
+//   flos_headless bench-cull [seed]        scalar vs simd frustum culling of instance spheres
+//   flos_headless bench-icosphere          planet mesh generation per subdivision level
+//   flos_headless bench-scaling [seed]     physics + transforms at 1/2/4/8 job threads
+//   flos_headless bench-lsystem            plant config expansion, compile, evaluation and library startup
+//   flos_headless bench-plant-mesh         branch mesh generation in vertices per second
+
+static void headless_run(u32 n_frames) {
+    f64 start = time_now();
+    usize n_bytes_uploaded = 0;
+    u64 n_draws = 0;
+    u64 n_instances = 0;
+    u64 n_tested = 0;
+    u64 n_visible = 0;
+    u64 n_horizon = 0;
+    u64 n_shader_switches = 0;
+    u64 n_binding_switches = 0;
+
+    for (u32 i = 0; i < n_frames; i++) {
+        game_on_frame(nullptr);
+        n_bytes_uploaded += render_null.frame.n_bytes_uploaded;
+        n_draws += render_null.frame.n_draws;
+        n_instances += render_null.frame.n_instances;
+        n_tested += renderer.cull.stats.n_tested;
+        n_visible += renderer.cull.stats.n_visible;
+        n_horizon += renderer.cull.stats.n_horizon_culled;
+        n_shader_switches += renderer.queue.stats.n_shader_switches;
+        n_binding_switches += renderer.queue.stats.n_binding_switches;
+    }
+
+    f64 elapsed = time_now() - start;
+    f64 frames = n_frames ? (f64)n_frames : 1.0;
+
+    mrw_debug("frames: {}", n_frames);
+    mrw_debug("cpu frame: {.4f} ms", elapsed * 1000.0 / frames);
+    mrw_debug("draws/frame: {.1f}", (f64)n_draws / frames);
+    mrw_debug("shader switches/frame: {.1f}", (f64)n_shader_switches / frames);
+    mrw_debug("binding switches/frame: {.1f}", (f64)n_binding_switches / frames);
+    mrw_debug("instances/frame: {.1f}", (f64)n_instances / frames);
+    mrw_debug("visible/frame: {.1f}", (f64)n_visible / frames);
+    mrw_debug("culled/frame: {.1f}", (f64)(n_tested - n_visible) / frames);
+    mrw_debug("horizon culled/frame: {.1f}", (f64)n_horizon / frames);
+    mrw_debug("uploaded/frame: {.1f} bytes", (f64)n_bytes_uploaded / frames);
+}
+
+static u64 headless_arg(i32 argc, char** argv, i32 i, u64 fallback) {
+    return argc > i ? strtoull(argv[i], nullptr, 10) : fallback;
+}
+
+i32 main(i32 argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "bench-transforms") == 0) {
+        memory_init();
+        bench_transforms(headless_arg(argc, argv, 2, 1));
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "bench-cull") == 0) {
+        memory_init();
+        bench_cull(headless_arg(argc, argv, 2, 1));
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "bench-icosphere") == 0) {
+        memory_init();
+        bench_icosphere();
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "bench-plant-mesh") == 0) {
+        memory_init();
+        bench_plant_mesh();
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "bench-lsystem") == 0) {
+        memory_init();
+        profile_init();
+        jobs_init(0);
+        bench_lsystem();
+        jobs_shutdown();
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "bench-scaling") == 0) {
+        memory_init();
+        profile_init();
+        jobs_init(0);
+        bench_scaling(headless_arg(argc, argv, 2, 1));
+        jobs_shutdown();
+        return 0;
+    }
+
+    bool bench = argc > 1 && strcmp(argv[1], "bench") == 0;
+
+    BenchConfig config = {
+        .n_frames = (u32)headless_arg(argc, argv, bench ? 2 : 1, 600),
+        .dt = 1.0f / 60.0f,
+        .seed = headless_arg(argc, argv, 3, 1),
+    };
+
+    random_seed(config.seed);
+
+    memory_init();
+    profile_init();
+    jobs_init(0);
+    window_init();
+    render_init();
+    game_init();
+
+    if (bench) {
+        bench_frames(config);
+    }
+    else {
+        headless_run(config.n_frames);
+    }
+
+    terrain_shutdown(&game.terrain);
+    jobs_shutdown();
+    profile_dump("./flos_trace.json");
+
+    return 0;
+}
@@ -0,0 +1,252 @@
+#define FLOS_JOBS
+#include "base.c"
+
+// job system: one worker per spare core, each thread owns a work stealing
+// deque (chase-lev). a thread pushes and pops its own deque from the bottom,
+// idle threads steal from the top of everyone else's
+//
+//     JobCounter counter = { 0 };
+//     jobs_parallel_for(&counter, "name", n, batch, fn, data);
+//     job_wait(&counter);
+//
+// job_wait doesn't block, the waiting thread runs jobs until the counter is
+// done. jobs can push more jobs from inside. every job is a range [start, end)
+// so splitting a loop doesn't need anything allocated per job
+//
+// on emscripten there are no workers, jobs run inline as they are pushed
+
+#ifndef __EMSCRIPTEN__
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#define JOBS_THREADED
+#endif
+
+#include <stdatomic.h>
+
+#define JOBS_MAX_THREADS 16
+#define JOBS_DEQUE_SIZE 4096
+
+STRUCT(JobCounter) {
+    atomic_uint pending;
+};
+
+typedef void (*JobFn)(void* data, u32 start, u32 end);
+
+STRUCT(Job) {
+    cstr name;
+    JobFn fn;
+    void* data;
+    u32 start, end;
+    JobCounter* counter;
+};
+
+static void job_execute(Job job) {
+    PROFILE_ZONE(job.name ? job.name : "job") job.fn(job.data, job.start, job.end);
+    if (job.counter) atomic_fetch_sub_explicit(&job.counter->pending, 1, memory_order_acq_rel);
+}
+
+#ifdef JOBS_THREADED
+
+STRUCT(JobDeque) {
+    _Alignas(64) atomic_llong top;
+    _Alignas(64) atomic_llong bottom;
+    Job jobs[JOBS_DEQUE_SIZE];
+};
+
+struct {
+    u32 n_threads;
+    // static so the _Alignas holds and re-initing with another thread count
+    // reuses them, the allocators don't promise 64 byte alignment
+    JobDeque deques[JOBS_MAX_THREADS];
+    pthread_t workers[JOBS_MAX_THREADS];
+
+    // jobs sitting in any deque, idle workers sleep while it's 0
+    atomic_uint n_queued;
+    atomic_uint n_sleeping;
+    atomic_bool quit;
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+} jobs = { 0 };
+
+// 0 is whichever thread called jobs_init, workers are 1 and up
+static _Thread_local u32 jobs_thread = 0;
+
+static bool job_deque_push(JobDeque* deque, Job job) {
+    i64 b = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    i64 t = atomic_load_explicit(&deque->top, memory_order_acquire);
+    if (b - t >= JOBS_DEQUE_SIZE) return false;
+
+    deque->jobs[b & (JOBS_DEQUE_SIZE - 1)] = job;
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+    return true;
+}
+
+static bool job_deque_pop(JobDeque* deque, Job* job) {
+    i64 b = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&deque->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    i64 t = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if (t > b) {
+        atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+        return false;
+    }
+
+    *job = deque->jobs[b & (JOBS_DEQUE_SIZE - 1)];
+    if (t < b) return true;
+
+    // last one, race the thieves for it
+    bool won = atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed);
+    atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+    return won;
+}
+
+static bool job_deque_steal(JobDeque* deque, Job* job) {
+    i64 t = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    i64 b = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+    if (t >= b) return false;
+
+    Job stolen = deque->jobs[t & (JOBS_DEQUE_SIZE - 1)];
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed)) {
+        return false;
+    }
+    *job = stolen;
+    return true;
+}
+
+static bool jobs_take(Job* job) {
+    u32 self = jobs_thread;
+    bool found = job_deque_pop(&jobs.deques[self], job);
+    for (u32 i = 1; i < jobs.n_threads && !found; i++) {
+        found = job_deque_steal(&jobs.deques[(self + i) % jobs.n_threads], job);
+    }
+    if (found) atomic_fetch_sub(&jobs.n_queued, 1);
+    return found;
+}
+
+static void* jobs_worker(void* arg) {
+    jobs_thread = (u32)(usize)arg;
+
+    while (!atomic_load(&jobs.quit)) {
+        Job job;
+        if (jobs_take(&job)) {
+            job_execute(job);
+            continue;
+        }
+
+        pthread_mutex_lock(&jobs.mutex);
+        atomic_fetch_add(&jobs.n_sleeping, 1);
+        while (!atomic_load(&jobs.n_queued) && !atomic_load(&jobs.quit)) {
+            pthread_cond_wait(&jobs.wake, &jobs.mutex);
+        }
+        atomic_fetch_sub(&jobs.n_sleeping, 1);
+        pthread_mutex_unlock(&jobs.mutex);
+    }
+    return nullptr;
+}
+
+// n_threads counts the calling thread, 0 picks one per core
+void jobs_init(u32 n_threads) {
+    if (!n_threads) {
+        i64 n_cores = sysconf(_SC_NPROCESSORS_ONLN);
+        n_threads = n_cores > 0 ? (u32)n_cores : 1;
+    }
+    n_threads = clamp(n_threads, 1u, (u32)JOBS_MAX_THREADS);
+
+    jobs.n_threads = n_threads;
+    for (u32 i = 0; i < n_threads; i++) {
+        atomic_init(&jobs.deques[i].top, 0);
+        atomic_init(&jobs.deques[i].bottom, 0);
+    }
+    atomic_init(&jobs.n_queued, 0);
+    atomic_init(&jobs.n_sleeping, 0);
+    atomic_init(&jobs.quit, false);
+    pthread_mutex_init(&jobs.mutex, nullptr);
+    pthread_cond_init(&jobs.wake, nullptr);
+
+    jobs_thread = 0;
+    for (u32 i = 1; i < n_threads; i++) {
+        pthread_create(&jobs.workers[i], nullptr, jobs_worker, (void*)(usize)i);
+    }
+}
+
+// lets running jobs finish, anything still queued is dropped
+void jobs_shutdown(void) {
+    pthread_mutex_lock(&jobs.mutex);
+    atomic_store(&jobs.quit, true);
+    pthread_cond_broadcast(&jobs.wake);
+    pthread_mutex_unlock(&jobs.mutex);
+
+    for (u32 i = 1; i < jobs.n_threads; i++) {
+        pthread_join(jobs.workers[i], nullptr);
+    }
+    pthread_mutex_destroy(&jobs.mutex);
+    pthread_cond_destroy(&jobs.wake);
+    jobs.n_threads = 0;
+}
+
+u32 jobs_n_threads(void) {
+    return jobs.n_threads;
+}
+
+void jobs_push(Job job) {
+    if (job.counter) atomic_fetch_add_explicit(&job.counter->pending, 1, memory_order_relaxed);
+
+    if (!job_deque_push(&jobs.deques[jobs_thread], job)) {
+        // own deque is full, do it now rather than drop it
+        job_execute(job);
+        return;
+    }
+
+    atomic_fetch_add(&jobs.n_queued, 1);
+    if (atomic_load(&jobs.n_sleeping)) {
+        pthread_mutex_lock(&jobs.mutex);
+        pthread_cond_signal(&jobs.wake);
+        pthread_mutex_unlock(&jobs.mutex);
+    }
+}
+
+// runs other jobs while waiting, so waiting from inside a job can't deadlock
+void job_wait(JobCounter* counter) {
+    while (atomic_load_explicit(&counter->pending, memory_order_acquire)) {
+        Job job;
+        if (jobs_take(&job)) job_execute(job);
+        else sched_yield();
+    }
+}
+
+#else // JOBS_THREADED
+
+void jobs_init(u32 n_threads) { }
+void jobs_shutdown(void) { }
+
+u32 jobs_n_threads(void) {
+    return 1;
+}
+
+void jobs_push(Job job) {
+    if (job.counter) atomic_fetch_add_explicit(&job.counter->pending, 1, memory_order_relaxed);
+    job_execute(job);
+}
+
+void job_wait(JobCounter* counter) { }
+
+#endif // JOBS_THREADED
+
+// splits [0, n) into jobs of at most batch items
+void jobs_parallel_for(JobCounter* counter, cstr name, u32 n, u32 batch, JobFn fn, void* data) {
+    batch = max(batch, 1u);
+    for (u32 start = 0; start < n; start += batch) {
+        jobs_push((Job){
+            .name = name,
+            .fn = fn,
+            .data = data,
+            .start = start,
+            .end = min(start + batch, n),
+            .counter = counter,
+        });
+    }
+}
@@ -1,11 +1,66 @@
 #include "base.c"
 
-i32 main(void) {
+// usage:
+//   flos                  run the game
+//   flos bench-startup    json timings of every init phase and the first frame, then exit
+
+#ifndef __EMSCRIPTEN__
+// the startup benchmark, printed like the headless benches. pipelines are
+// compiled by the real backend here, headless has none to compile
+static cstr main_phases[] = { "memory_init", "jobs_init", "window_init", "render_init", "game_init", "ui_init", "first_frame" };
+static f64 main_phase_times[array_len(main_phases)];
+static f64 main_phase_start;
+
+// time_now starts with glfw in window_init, the phases before it need a clock
+// of their own
+static f64 main_clock(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (f64)ts.tv_sec + (f64)ts.tv_nsec * 1e-9;
+}
+
+// ends the running phase and starts the next
+static void main_phase(u32 phase) {
+    f64 now = main_clock();
+    main_phase_times[phase] = now - main_phase_start;
+    main_phase_start = now;
+}
+
+static void main_report_startup(f64 start) {
+    printf("{\n");
+    printf("  \"bench\": \"startup\",\n");
+    printf("  \"phases_ms\": {\n");
+    for (u32 i = 0; i < array_len(main_phases); i++) {
+        printf("    \"%s\": %.3f%s\n", main_phases[i], main_phase_times[i] * 1e3, i + 1 < array_len(main_phases) ? "," : "");
+    }
+    printf("  },\n");
+    printf("  \"first_frame_ms\": %.3f,\n", (main_clock() - start) * 1e3);
+    printf("  \"shaders\": { \"compiled\": %u, \"cache_hits\": %u }\n",
+        shaders.stats.n_compiled, shaders.stats.n_cache_hits);
+    printf("}\n");
+}
+#else // __EMSCRIPTEN__
+static void main_phase(u32 phase) { }
+#endif // __EMSCRIPTEN__
+
+i32 main(i32 argc, char** argv) {
+#ifndef __EMSCRIPTEN__
+    bool bench_startup = argc > 1 && strcmp(argv[1], "bench-startup") == 0;
+    f64 start = main_phase_start = main_clock();
+#endif // __EMSCRIPTEN__
     memory_init();
+    profile_init();
+    main_phase(0);
+    jobs_init(0);
+    main_phase(1);
     window_init();
+    main_phase(2);
     render_init();
+    main_phase(3);
     game_init();
+    main_phase(4);
     ui_init();
+    main_phase(5);
 
 #ifdef __EMSCRIPTEN__
     emscripten_set_main_loop_arg(main_loop, nullptr, 0, true);
@@ -13,7 +68,17 @@ i32 main(void) {
     while (!glfwWindowShouldClose(window.window)) {
         glfwPollEvents();
         game_on_frame(nullptr);
+        if (bench_startup) {
+            main_phase(6);
+            main_report_startup(start);
+            break;
+        }
     };
+
+    terrain_shutdown(&game.terrain);
+    shaders_shutdown();
+    jobs_shutdown();
+    profile_dump("./flos_trace.json");
 #endif // __EMSCRIPTEN__
 
     return 1;
@@ -6,10 +6,13 @@ STRUCT(Vertex) {
     vec3s normal;
 };
 
+// read from a storage buffer in planet.wgsl, one per planet. where its shells
+// start among the instances of a draw comes from the visible list, see
+// render_cull_instances
 STRUCT(PlanetInstance) {
     mat4s mat;
-    f32 shell_t;
     f32 scale;
+    u32 n_shells;
     f32 _pad[2];
 };
 
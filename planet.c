@@ -27,64 +27,132 @@ u16 icosahedron_indices[] = {
     8, 9, 5, 9, 10, 6, 10, 11, 7, 6, 11, 8,  7, 11, 9, 8, 11, 10, 9, 11,
 };
 
-static void subdivide(VertexSlice *vertices, u16 *indices, usize *n_indices) {
-    u32 n = *n_indices;
-    for (u32 i = 0; i < n; i += 3) {
-        u16 i1 = indices[i + 0];
-        u16 i3 = indices[i + 1];
-        u16 i5 = indices[i + 2];
-        Vertex v1 = vertices->start[i1];
-        Vertex v3 = vertices->start[i3];
-        Vertex v5 = vertices->start[i5];
-
-        Vertex v2 = { .position = vec3_scale(vec3_add(v1.position, v3.position), 0.5f) };
-        Vertex v4 = { .position = vec3_scale(vec3_add(v3.position, v5.position), 0.5f) };
-        Vertex v6 = { .position = vec3_scale(vec3_add(v5.position, v1.position), 0.5f) };
-
-        u16 i2 = slice_count(*vertices);
-        *(vertices->end++) = v2;
-        u16 i4 = slice_count(*vertices);
-        *(vertices->end++) = v4;
-        u16 i6 = slice_count(*vertices);
-        *(vertices->end++) = v6;
-
-        indices[i] = i1;
-        indices[i + 1] = i2;
-        indices[i + 2] = i6;
-        indices[(*n_indices)++] = i2;
-        indices[(*n_indices)++] = i3;
-        indices[(*n_indices)++] = i4;
-        indices[(*n_indices)++] = i4;
-        indices[(*n_indices)++] = i5;
-        indices[(*n_indices)++] = i6;
-        indices[(*n_indices)++] = i6;
-        indices[(*n_indices)++] = i2;
-        indices[(*n_indices)++] = i4;
+// icosphere levels, each one splits every triangle of the previous one in 4.
+// level l has 10 * 4^l + 2 vertices, 6 is the last one u16 indices reach
+#define PLANET_MAX_LEVEL 6
+
+// subdivision level of each render lod
+#define PLANET_LOD_LEVELS 4
+static const u32 planet_lod_subdivisions[PLANET_LOD_LEVELS] = { 1, 2, 4, 6 };
+
+// every level up to n_levels - 1 from one generation pass. midpoints are only
+// ever appended, so the vertices of a level are a prefix of the next one's
+// and all levels share one vertex array
+STRUCT(PlanetLodTable) {
+    Vertex* vertices;
+    struct {
+        u32* indices;
+        u32 n_indices;
+        u32 n_vertices;
+    } levels[PLANET_MAX_LEVEL + 1];
+    u32 n_levels;
+};
+
+#define PLANET_NO_EDGE 0xFFFFFFFFFFFFFFFFull
+
+// open addressing map from an edge to the vertex at its midpoint, so a
+// midpoint shared by two triangles is only emitted once
+STRUCT(PlanetEdgeCache) {
+    u64* keys;
+    u32* values;
+    u32 mask;
+};
+
+static u32 planet_midpoint(PlanetEdgeCache* cache, Vertex* vertices, u32* n_vertices, u32 a, u32 b) {
+    u64 key = a < b ? ((u64)a << 32 | b) : ((u64)b << 32 | a);
+    u32 slot = (u32)((key * 0x9E3779B97F4A7C15ull) >> 32) & cache->mask;
+    while (cache->keys[slot] != PLANET_NO_EDGE) {
+        if (cache->keys[slot] == key) return cache->values[slot];
+        slot = (slot + 1) & cache->mask;
     }
-}
 
-PlanetMesh planet_meshify(Allocator* allocator) {
-    usize n_vertices_start = array_len(icosahedron_indices) / 3;
-    usize n_indices_start = array_len(icosahedron_indices);
-    usize n_vertices = n_vertices_start * 6 * 6;
-    usize n_indices = n_indices_start * 4 * 4;
-    Vertex* vertices = mrw_alloc_n(allocator, Vertex, n_vertices);
-    u16* indices = mrw_alloc_n(allocator, u16, n_indices);
+    u32 index = (*n_vertices)++;
+    vec3s position = vec3_normalize(vec3_add(vertices[a].position, vertices[b].position));
+    vertices[index] = (Vertex){ .position = position, .normal = position };
+    cache->keys[slot] = key;
+    cache->values[slot] = index;
+    return index;
+}
 
-    buf_copy(vertices, icosahedron_vertices, sizeof(icosahedron_vertices));
-    buf_copy(indices, icosahedron_indices, sizeof(icosahedron_indices));
+PlanetLodTable planet_lod_table(u32 max_level, Allocator* allocator) {
+    PROFILE_BEGIN("planet_lod_table");
 
-    VertexSlice vertex_slice = slice_to(vertices, n_vertices_start);
-    subdivide(&vertex_slice, indices, &n_indices_start);
-    subdivide(&vertex_slice, indices, &n_indices_start);
+    max_level = min(max_level, PLANET_MAX_LEVEL);
+    PlanetLodTable table = { .n_levels = max_level + 1 };
+    table.vertices = mrw_alloc_n(allocator, Vertex, 10 * (1u << (2 * max_level)) + 2);
 
+    u32 n_vertices = array_len(icosahedron_vertices);
     for (u32 i = 0; i < n_vertices; i++) {
-        Vertex* v = &vertices[i];
-        v->position = v->normal = vec3_normalize(v->position);
+        vec3s position = vec3_normalize(icosahedron_vertices[i].position);
+        table.vertices[i] = (Vertex){ .position = position, .normal = position };
     }
 
-    return (PlanetMesh) {
-      .vertices = slice_to(vertices, n_vertices),
-      .indices = slice_to(indices, n_indices),
-    };
+    u32* indices = mrw_alloc_n(allocator, u32, array_len(icosahedron_indices));
+    for (u32 i = 0; i < array_len(icosahedron_indices); i++) {
+        indices[i] = icosahedron_indices[i];
+    }
+    table.levels[0].indices = indices;
+    table.levels[0].n_indices = array_len(icosahedron_indices);
+    table.levels[0].n_vertices = n_vertices;
+
+    for (u32 level = 1; level <= max_level; level++) {
+        u32* prev = table.levels[level - 1].indices;
+        u32 n_prev = table.levels[level - 1].n_indices;
+
+        // a closed mesh has 3/2 edges per triangle, keep the map at most half full
+        u32 n_edges = n_prev / 2;
+        u32 n_slots = 1;
+        while (n_slots < n_edges * 2) n_slots <<= 1;
+        PlanetEdgeCache cache = {
+            .keys = mrw_alloc_n(allocator, u64, n_slots),
+            .values = mrw_alloc_n(allocator, u32, n_slots),
+            .mask = n_slots - 1,
+        };
+        memset(cache.keys, 0xFF, n_slots * sizeof(u64));
+
+        u32* next = mrw_alloc_n(allocator, u32, n_prev * 4);
+        u32 n_next = 0;
+        for (u32 i = 0; i < n_prev; i += 3) {
+            u32 a = prev[i + 0];
+            u32 b = prev[i + 1];
+            u32 c = prev[i + 2];
+            u32 ab = planet_midpoint(&cache, table.vertices, &n_vertices, a, b);
+            u32 bc = planet_midpoint(&cache, table.vertices, &n_vertices, b, c);
+            u32 ca = planet_midpoint(&cache, table.vertices, &n_vertices, c, a);
+
+            u32 triangles[] = {
+                a, ab, ca,
+                ab, b, bc,
+                bc, c, ca,
+                ca, ab, bc,
+            };
+            buf_copy(next + n_next, triangles, sizeof(triangles));
+            n_next += array_len(triangles);
+        }
+
+        table.levels[level].indices = next;
+        table.levels[level].n_indices = n_next;
+        table.levels[level].n_vertices = n_vertices;
+    }
+
+    PROFILE_END();
+    return table;
+}
+
+PlanetMesh planet_lod_mesh(PlanetLodTable* table, u32 level, Allocator* allocator) {
+    level = min(level, table->n_levels - 1);
+    u32 n_vertices = table->levels[level].n_vertices;
+    u32 n_indices = table->levels[level].n_indices;
+    u32* indices = table->levels[level].indices;
+
+    u16* narrow = mrw_alloc_n(allocator, u16, n_indices);
+    for (u32 i = 0; i < n_indices; i++) {
+        narrow[i] = (u16)indices[i];
+    }
+    return (PlanetMesh){ .vertices = slice_to(table->vertices, n_vertices), .indices = slice_to(narrow, n_indices) };
+}
+
+PlanetMesh planet_meshify(u32 level, Allocator* allocator) {
+    PlanetLodTable table = planet_lod_table(level, allocator);
+    return planet_lod_mesh(&table, level, allocator);
 }
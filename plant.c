@@ -1,28 +1,73 @@
 #define FLOS_PLANT
 #include "base.c"
 
+// plants are l-systems: the rules rewrite initial a number of times and the
+// resulting symbols are compiled into turtle ops once per config. the ops keep
+// their parameters as ranges, every plant evaluates them with its own rng so
+// distinct plants cost one walk over the ops and no string expansion
+//
+// symbols, with (a) or (a~b) after an op giving its parameter or range:
+//   shape    draw it and move forward, (x) scales the length
+//   + -      turn around the turtle's z by the current angle
+//   > <      same, by (degrees) when given
+//   ^ &      pitch around the turtle's x
+//   / \      roll around the turtle's heading
+//   |        (x) scales everything drawn after it, bare it turns around
+//   [ ]      push and pop the turtle
+// anything else is ignored by the turtle. both res/plant.json and
+// res/system.json parse into the same config
+
+typedef enum {
+    PST_Branch,
+    PST_Circle,
+} PlantShapeType;
+
+// everything is indexed by the symbol itself. symbols without a rule copy
+// themselves when expanding, symbols without a shape only steer the turtle
+STRUCT(PlantShapeConfig) {
+    bool defined;
+    PlantShapeType type;
+    f32 width;
+    f32 length;
+    // degrees, what + and - turn by after this shape was drawn
+    f32 angle;
+    // width at the end of a branch over its width at the start, what comes
+    // after it carries on from there
+    f32 taper;
+
+    // circles
+    f32 size;
+    vec3s color;
+};
+
+#define PLANT_DEFAULT_ITERATIONS 6
+#define PLANT_RADIAL_SEGMENTS 6
+#define PLANT_MAX_RADIAL_SEGMENTS 32
+
 STRUCT(PlantConfig) {
-    struct {
-        u32 iterations;
-        char initial[128];
-        struct {
-            char name;
-            char result[128];
-        } rules[8];
-        u32 n_rules;
-    } rules;
-    struct {
-        char name;
-        f32 width;
-        f32 length;
-        f32 angle;
-    } shapes[8];
-    u32 n_shapes;
+    u32 iterations;
+    u8Slice initial;
+    bool has_rule[256];
+    u8Slice rules[256];
+    PlantShapeConfig shapes[256];
+    // what the turtle turns by until it has drawn something, 0 takes the
+    // first shape's angle
+    f32 default_angle;
+    u8 first_shape;
+    // vertices around each branch ring
+    u32 radial_segments;
 };
 
+#define PLANT_NO_PARENT 0xFFFFFFFFu
+
 STRUCT(PlantShape) {
     vec3s start, end;
-    f32 width;
+    f32 width, end_width;
+    // the branch this one grows out of, its end ring is this one's start ring
+    u32 parent;
+    PlantShapeType type;
+    // carried for circles, nothing draws it yet
+    vec3s color;
 };
 
 STRUCT(PlantMesh) {
@@ -31,94 +76,717 @@ STRUCT(PlantMesh) {
 };
 
 STRUCT(PlantTemplate) {
-    PlantShape shapes[1024];
+    PlantShape* shapes;
     u32 n_shapes;
 };
 
-f32 branch = 0.2f;
-PlantShape *plant_step(PlantShape prev, PlantShape *shapes, f32 angle, u32 gen) {
-    if (gen > 6)
-        return shapes;
-    vec3s dir = vec3_scale(
-        vec3_rotate(GLMS_YUP, angle, GLMS_ZUP), 1.0f / ((float)gen + 1.0f)
-    );
-    vec3s start = prev.end;
-    PlantShape shape = (PlantShape){
-        .start = start,
-        .end = vec3_add(start, dir),
-        .width = .1f
-    };
-    (*shapes++) = shape;
-    shapes = plant_step(shape, shapes, angle - branch, gen + 1);
-    shapes = plant_step(shape, shapes, angle + branch, gen + 1);
-    return shapes;
+// templates are scaled to this height, whatever units the config uses
+#define PLANT_HEIGHT 2.5f
+
+static u8Slice plant_copy_string(str string, Allocator* allocator) {
+    usize size = slice_size(string);
+    u8* copy = mrw_alloc_n(allocator, u8, max(size, (usize)1));
+    buf_copy(copy, string.start, size);
+    return slice_to(copy, size);
 }
 
-PlantTemplate plant_generate(void) {
-    PlantTemplate p = { 0 };
-    p.n_shapes = plant_step(p.shapes[0], p.shapes, 0.0f, 0) - p.shapes;
-    return p;
+// numbers written without a dot come through as integers, anything that
+// isn't a number reads as 0
+static f32 plant_json_f32(JsonObject json) {
+    switch (json.val.type) {
+        case JSON_DECIMAL: return (f32)json.val.decimal;
+        case JSON_INTEGER: return (f32)json.val.integer;
+        default: return 0.0f;
+    }
 }
 
-PlantConfig plant_parse_config(JsonObject json) {
-    PlantConfig config = {0};
-    for (json = json_first(json); json.val.type; json = json_next(json)) {
-        if (str_cmp(json.label, str("rules")) == 0) {
-            config.rules.iterations = json_find(json, str("iterations")).val.integer;
-            str initial = json_find(json, str("initial")).val.string;
-            buf_copy(config.rules.initial, initial.start, slice_size(initial));
-            JsonObject rules = json_find(json, str("rules"));
-            for (rules = json_first(rules); rules.val.type;
-                rules = json_next(rules)) {
-                u32 i = config.rules.n_rules++;
-                config.rules.rules[i].name = rules.label.start[0];
-                str result = json_find(rules, str("result")).val.string;
-                buf_copy(config.rules.rules[i].result, result.start, slice_size(result));
+// { "X": "..." } or { "X": { "result": "..." } }
+static void plant_parse_rules(PlantConfig* config, JsonObject rules, Allocator* allocator) {
+    for (rules = json_first(rules); rules.val.type; rules = json_next(rules)) {
+        u8 symbol = (u8)rules.label.start[0];
+        JsonObject result = json_find(rules, str("result"));
+        config->has_rule[symbol] = true;
+        config->rules[symbol] = plant_copy_string(result.val.type ? result.val.string : rules.val.string, allocator);
+    }
+}
+
+// { "F": { "width": .. } } or typed, { "f": { "Branch": { .. } }, "s": { "Circle": { .. } } }
+static void plant_parse_shapes(PlantConfig* config, JsonObject shapes, bool* first) {
+    for (shapes = json_first(shapes); shapes.val.type; shapes = json_next(shapes)) {
+        u8 symbol = (u8)shapes.label.start[0];
+        JsonObject branch = json_find(shapes, str("Branch"));
+        JsonObject circle = json_find(shapes, str("Circle"));
+
+        PlantShapeConfig* shape = &config->shapes[symbol];
+        if (circle.val.type) {
+            *shape = (PlantShapeConfig){
+                .defined = true,
+                .type = PST_Circle,
+                .size = plant_json_f32(json_find(circle, str("size"))),
+            };
+            u32 c = 0;
+            JsonObject color = json_find(circle, str("color"));
+            for (color = json_first(color); color.val.type && c < 3; color = json_next(color)) {
+                shape->color.raw[c++] = plant_json_f32(color);
             }
+        } else {
+            JsonObject body = branch.val.type ? branch : shapes;
+            JsonObject taper = json_find(body, str("taper"));
+            *shape = (PlantShapeConfig){
+                .defined = true,
+                .type = PST_Branch,
+                .width = plant_json_f32(json_find(body, str("width"))),
+                .length = plant_json_f32(json_find(body, str("length"))),
+                .angle = plant_json_f32(json_find(body, str("angle"))),
+                .taper = taper.val.type ? plant_json_f32(taper) : 1.0f,
+            };
+        }
+
+        if (*first) config->first_shape = symbol;
+        *first = false;
+    }
+}
+
+static void plant_parse_into(PlantConfig* config, JsonObject json, bool* first, Allocator* allocator) {
+    for (json = json_first(json); json.val.type; json = json_next(json)) {
+        if (str_cmp(json.label, str("iterations")) == 0) {
+            config->iterations = json.val.integer;
+        } else if (str_cmp(json.label, str("radial_segments")) == 0) {
+            config->radial_segments = json.val.integer;
+        } else if (str_cmp(json.label, str("initial")) == 0) {
+            config->initial = plant_copy_string(json.val.string, allocator);
+        } else if (str_cmp(json.label, str("rules")) == 0) {
+            // plant.json nests iterations, initial and the rules themselves in here
+            if (json_find(json, str("rules")).val.type) plant_parse_into(config, json, first, allocator);
+            else plant_parse_rules(config, json, allocator);
         } else if (str_cmp(json.label, str("shapes")) == 0) {
-            JsonObject shapes = json;
-            for (shapes = json_first(shapes); shapes.val.type; shapes = json_next(shapes)) {
-                u32 i = config.n_shapes++;
-                config.shapes[i].name = shapes.label.start[0];
-                config.shapes[i].width = json_find(shapes, str("width")).val.decimal;
-                config.shapes[i].length = json_find(shapes, str("length")).val.decimal;
-                config.shapes[i].angle = json_find(shapes, str("angle")).val.decimal;
-            }
+            plant_parse_shapes(config, json, first);
+        } else if (str_cmp(json.label, str("rendering")) == 0) {
+            config->default_angle = plant_json_f32(json_find(json, str("default_angle_change")));
+            JsonObject radial_segments = json_find(json, str("radial_segments"));
+            if (radial_segments.val.type) config->radial_segments = radial_segments.val.integer;
+            plant_parse_shapes(config, json_find(json, str("shapes")), first);
         }
     }
+}
+
+// strings are copied out of the json, it doesn't have to outlive the config
+PlantConfig plant_parse_config(JsonObject json, Allocator* allocator) {
+    PlantConfig config = { .iterations = PLANT_DEFAULT_ITERATIONS, .radial_segments = PLANT_RADIAL_SEGMENTS };
+    bool first = true;
+    plant_parse_into(&config, json, &first, allocator);
+    config.radial_segments = clamp(config.radial_segments, 3u, (u32)PLANT_MAX_RADIAL_SEGMENTS);
     return config;
 }
 
-PlantMesh plant_meshify(PlantTemplate *plant, Allocator* allocator) {
-    usize n_vertices = plant->n_shapes * 4;
-    usize n_indices = plant->n_shapes * 6;
-    Vertex* vertices = mrw_alloc_n(allocator, Vertex, n_vertices);
-    u16* indices = mrw_alloc_n(allocator, u16, n_indices);
+// the two symbol buffers generations stream between, one is read while the
+// other is written and they swap every iteration. they keep their capacity so
+// expanding more plants through the same one stops allocating after the first
+STRUCT(PlantExpansion) {
+    VEKTOR(u8) buffers[2];
+    usize n[2];
+};
 
-    u32 vi = 0, ii = 0;
+void plant_expansion_init(PlantExpansion* expansion, u32 capacity, Allocator* allocator) {
+    *expansion = (PlantExpansion){ 0 };
+    vektor_init(expansion->buffers[0], capacity, allocator);
+    vektor_init(expansion->buffers[1], capacity, allocator);
+}
+
+void plant_expansion_free(PlantExpansion* expansion) {
+    vektor_free(expansion->buffers[0]);
+    vektor_free(expansion->buffers[1]);
+}
+
+// runs the rules over initial config->iterations times. parameter groups are
+// copied as they are. the result lives in the expansion and is only valid
+// until the next call
+u8Slice plant_expand(PlantExpansion* expansion, PlantConfig* config) {
+    PROFILE_BEGIN("plant_expand");
+
+    u32 front = 0;
+    vektor_clear(expansion->buffers[front]);
+    vektor_add_arr(expansion->buffers[front], config->initial);
+    expansion->n[front] = slice_count(config->initial);
+
+    for (u32 i = 0; i < config->iterations; i++) {
+        u32 back = front ^ 1;
+        vektor_clear(expansion->buffers[back]);
+
+        u8* symbols = slice_vektor(expansion->buffers[front]).start;
+        usize n_symbols = expansion->n[front];
+        usize n = 0;
+        bool in_parameter = false;
+        for (usize s = 0; s < n_symbols; s++) {
+            u8 symbol = symbols[s];
+            if (symbol == '(') in_parameter = true;
+            else if (symbol == ')') in_parameter = false;
+
+            if (!in_parameter && config->has_rule[symbol]) {
+                vektor_add_arr(expansion->buffers[back], config->rules[symbol]);
+                n += slice_count(config->rules[symbol]);
+            } else {
+                vektor_add(expansion->buffers[back], symbol);
+                n++;
+            }
+        }
+
+        expansion->n[back] = n;
+        front = back;
+    }
+
+    PROFILE_END();
+    return slice_to((u8*)slice_vektor(expansion->buffers[front]).start, expansion->n[front]);
+}
+
+typedef enum {
+    PO_Draw,
+    PO_Yaw,
+    PO_Pitch,
+    PO_Roll,
+    PO_Scale,
+    PO_Push,
+    PO_Pop,
+} PlantOpCode;
+
+// the parameter is drawn from [min, max] per plant. step ops multiply it by
+// the turtle's current angle instead of using it as degrees
+STRUCT(PlantOp) {
+    PlantOpCode code;
+    u8 shape;
+    bool step;
+    f32 min, max;
+};
+
+STRUCT(PlantProgram) {
+    PlantOp* ops;
+    u32 n_ops;
+    u32 n_draws;
+    u32 max_depth;
+    f32 default_angle;
+};
+
+// reads "(a)" or "(a~b)" at *i if there is one, leaving *i past it
+static bool plant_parse_parameter(u8* s, usize n, usize* i, f32* min, f32* max) {
+    if (*i >= n || s[*i] != '(') return false;
+
+    char text[64];
+    usize len = 0;
+    for ((*i)++; *i < n && s[*i] != ')'; (*i)++) {
+        if (len < sizeof(text) - 1) text[len++] = (char)s[*i];
+    }
+    if (*i < n) (*i)++;
+    text[len] = 0;
+
+    char* rest = nullptr;
+    *min = *max = strtof(text, &rest);
+    if (rest && *rest == '~') *max = strtof(rest + 1, nullptr);
+    return true;
+}
+
+// compiles expanded symbols into ops, once per config
+PlantProgram plant_compile(PlantConfig* config, u8Slice symbols, Allocator* allocator) {
+    PROFILE_BEGIN("plant_compile");
+
+    u8* s = symbols.start;
+    usize n = slice_count(symbols);
+
+    // every symbol is at most one op
+    PlantProgram program = {
+        .ops = mrw_alloc_n(allocator, PlantOp, max(n, (usize)1)),
+        .default_angle = config->default_angle != 0.0f ? config->default_angle : config->shapes[config->first_shape].angle,
+    };
+
+    u32 depth = 0;
+    for (usize i = 0; i < n;) {
+        u8 symbol = s[i++];
+        PlantOp op = { .min = 1.0f, .max = 1.0f };
+        bool has_parameter = plant_parse_parameter(s, n, &i, &op.min, &op.max);
+
+        if (config->shapes[symbol].defined) {
+            op.code = PO_Draw;
+            op.shape = symbol;
+            program.n_draws++;
+        }
+        else switch (symbol) {
+            case '+': case '-': case '>': case '<':
+            case '^': case '&': case '/': case '\\': {
+                bool negative = symbol == '-' || symbol == '<' || symbol == '&' || symbol == '\\';
+                op.code = (symbol == '^' || symbol == '&') ? PO_Pitch : (symbol == '/' || symbol == '\\') ? PO_Roll : PO_Yaw;
+                op.step = !has_parameter;
+                if (negative) {
+                    f32 min = op.min;
+                    op.min = -op.max;
+                    op.max = -min;
+                }
+            } break;
+            case '|':
+                if (has_parameter) op.code = PO_Scale;
+                else op = (PlantOp){ .code = PO_Yaw, .min = 180.0f, .max = 180.0f };
+                break;
+            case '[':
+                op.code = PO_Push;
+                program.max_depth = max(program.max_depth, ++depth);
+                break;
+            case ']':
+                if (!depth) continue;
+                op.code = PO_Pop;
+                depth--;
+                break;
+            default:
+                continue;
+        }
+
+        program.ops[program.n_ops++] = op;
+    }
+
+    PROFILE_END();
+    return program;
+}
+
+STRUCT(PlantTurtle) {
+    vec3s pos;
+    quats rot;
+    f32 angle;
+    f32 scale;
+    // what tapering has left of the width
+    f32 width;
+    // last branch drawn, what the next one grows out of
+    u32 segment;
+};
+
+static inline f32 plant_op_value(PlantOp op, Rng* rng) {
+    return op.min == op.max ? op.min : rng_f32(rng, op.min, op.max);
+}
+
+// walks the ops with one plant's rng. shapes has room for program->n_draws
+// and stack for program->max_depth, nothing grows while drawing
+PlantTemplate plant_evaluate_into(PlantConfig* config, PlantProgram* program, u64 seed, PlantShape* shapes, PlantTurtle* stack) {
+    PROFILE_BEGIN("plant_evaluate");
+
+    Rng rng = rng_seeded(seed);
+    PlantTemplate plant = { .shapes = shapes };
+    u32 depth = 0;
+
+    PlantTurtle turtle = {
+        .rot = { .w = 1.0f },
+        .angle = program->default_angle,
+        .scale = 1.0f,
+        .width = 1.0f,
+        .segment = PLANT_NO_PARENT,
+    };
+    for (u32 i = 0; i < program->n_ops; i++) {
+        PlantOp op = program->ops[i];
+        f32 value = plant_op_value(op, &rng);
+        if (op.step) value *= turtle.angle;
+
+        switch (op.code) {
+            case PO_Draw: {
+                PlantShapeConfig* shape = &config->shapes[op.shape];
+                vec3s heading = quat_rotatev(turtle.rot, GLMS_YUP);
+                f32 length = (shape->type == PST_Circle ? shape->size : shape->length) * turtle.scale * value;
+                vec3s end = vec3_add(turtle.pos, vec3_scale(heading, length));
+                f32 width = shape->type == PST_Circle ? shape->size * turtle.scale : shape->width * turtle.scale * turtle.width;
+                f32 end_width = shape->type == PST_Circle ? width : width * shape->taper;
+                u32 index = plant.n_shapes++;
+                plant.shapes[index] = (PlantShape){
+                    .start = turtle.pos,
+                    .end = end,
+                    .width = width,
+                    .end_width = end_width,
+                    .parent = turtle.segment,
+                    .type = shape->type,
+                    .color = shape->color,
+                };
+                // circles sit at the tip, they don't move the turtle
+                if (shape->type == PST_Branch) {
+                    turtle.pos = end;
+                    turtle.angle = shape->angle;
+                    turtle.width *= shape->taper;
+                    turtle.segment = index;
+                }
+            } break;
+            case PO_Yaw:   turtle.rot = quat_mul(turtle.rot, glms_quatv(glm_rad(value), GLMS_ZUP)); break;
+            case PO_Pitch: turtle.rot = quat_mul(turtle.rot, glms_quatv(glm_rad(value), GLMS_XUP)); break;
+            case PO_Roll:  turtle.rot = quat_mul(turtle.rot, glms_quatv(glm_rad(value), GLMS_YUP)); break;
+            case PO_Scale: turtle.scale *= value; break;
+            case PO_Push:  stack[depth++] = turtle; break;
+            case PO_Pop:   turtle = stack[--depth]; break;
+        }
+    }
+
+    PROFILE_END();
+    return plant;
+}
+
+PlantTemplate plant_evaluate(PlantConfig* config, PlantProgram* program, u64 seed, Allocator* allocator) {
+    PlantShape* shapes = mrw_alloc_n(allocator, PlantShape, max(program->n_draws, 1u));
+    PlantTurtle* stack = mrw_alloc_n(allocator, PlantTurtle, max(program->max_depth, 1u));
+    return plant_evaluate_into(config, program, seed, shapes, stack);
+}
+
+// scales the whole template so it's height tall
+void plant_normalize(PlantTemplate* plant, f32 height) {
+    f32 top = 0.0f;
     for (u32 i = 0; i < plant->n_shapes; i++) {
+        top = max(top, max(plant->shapes[i].start.y, plant->shapes[i].end.y));
+    }
+    if (top <= 0.0f) return;
+
+    f32 scale = height / top;
+    for (u32 i = 0; i < plant->n_shapes; i++) {
+        plant->shapes[i].start = vec3_scale(plant->shapes[i].start, scale);
+        plant->shapes[i].end = vec3_scale(plant->shapes[i].end, scale);
+        plant->shapes[i].width *= scale;
+        plant->shapes[i].end_width *= scale;
+    }
+}
+
+PlantProgram plant_program(PlantConfig* config, Allocator* allocator) {
+    PlantExpansion expansion;
+    plant_expansion_init(&expansion, 1024, memory.stable);
+    PlantProgram program = plant_compile(config, plant_expand(&expansion, config), allocator);
+    plant_expansion_free(&expansion);
+    return program;
+}
+
+// what plant_meshify writes for a template, the same for every variant of a
+// config since they share their shapes' parent links. only the first n_shapes
+// are meshed, with radial vertices per ring
+STRUCT(PlantMeshSize) {
+    u32 n_vertices;
+    u32 n_indices;
+    u32 n_shapes;
+    u32 radial;
+};
+
+// circles are octahedra
+#define PLANT_CIRCLE_VERTICES 6
+#define PLANT_CIRCLE_INDICES 24
+
+// reni only takes u16 indices
+#define PLANT_MAX_VERTICES 0x10000u
+
+// rings lose vertices down to 3 until the mesh fits u16 indices, if it still
+// doesn't only the shapes that fit are meshed. shapes come after their parents
+// so any prefix of them keeps its parent links
+PlantMeshSize plant_mesh_size(PlantTemplate* plant, u32 radial) {
+    PlantMeshSize size = { .radial = radial };
+    while (true) {
+        size.n_vertices = size.n_indices = size.n_shapes = 0;
+        for (u32 i = 0; i < plant->n_shapes; i++) {
+            PlantShape* s = &plant->shapes[i];
+            u32 n_vertices = PLANT_CIRCLE_VERTICES, n_indices = PLANT_CIRCLE_INDICES;
+            if (s->type != PST_Circle) {
+                n_vertices = size.radial * (s->parent == PLANT_NO_PARENT ? 2 : 1);
+                n_indices = size.radial * 6;
+            }
+            if (size.n_vertices + n_vertices > PLANT_MAX_VERTICES) break;
+            size.n_vertices += n_vertices;
+            size.n_indices += n_indices;
+            size.n_shapes++;
+        }
+        if (size.n_shapes == plant->n_shapes || size.radial <= 3) break;
+        size.radial--;
+    }
+    if (size.n_shapes < plant->n_shapes) {
+        mrw_debug("plant mesh keeps {} of {} shapes to fit u16 indices", size.n_shapes, plant->n_shapes);
+    }
+    return size;
+}
+
+// a branch's end ring, its children start from it. right is where vertex 0
+// sits, carried from parent to child by the smallest rotation so rings don't
+// twist against each other
+STRUCT(PlantRing) {
+    u32 first;
+    vec3s dir;
+    vec3s right;
+};
+
+static u32 plant_write_ring(Vertex* vertices, u32 vi, u32 radial, vec3s center, f32 radius, vec3s dir, vec3s right, f32 slope) {
+    vec3s up = vec3_cross(dir, right);
+    for (u32 k = 0; k < radial; k++) {
+        f32 a = 2.0f * (f32)M_PI * (f32)k / (f32)radial;
+        vec3s out = vec3_add(vec3_scale(right, cosf(a)), vec3_scale(up, sinf(a)));
+        vertices[vi + k] = (Vertex){
+            .position = vec3_add(center, vec3_scale(out, radius)),
+            .normal = vec3_normalize(vec3_add(out, vec3_scale(dir, slope))),
+        };
+    }
+    return vi + radial;
+}
+
+// branches become tapered cylinders with radial vertices per ring, children
+// share their parent's end ring. vertices, indices and rings have room for
+// plant_mesh_size and n_shapes
+PlantMesh plant_meshify_into(PlantTemplate* plant, PlantMeshSize size, Vertex* vertices, u16* indices, PlantRing* rings) {
+    PROFILE_BEGIN("plant_meshify");
+
+    u32 radial = size.radial;
+    u32 vi = 0, ii = 0;
+    for (u32 i = 0; i < size.n_shapes; i++) {
         PlantShape s = plant->shapes[i];
-        vec3s dir = vec3_normalize(vec3_sub(s.start, s.end));
-        vec3s right = fabsf(dir.y) > 0.995
-                        ? (vec3s){ .x = 1.0f }
-                        : vec3_normalize((vec3s){ .x = -dir.z, .z = dir.x });
-        right = vec3_scale(right, 0.5f * s.width);
-
-        i32 r = vi;
-        vertices[vi++] = (Vertex){ .position = vec3_add(s.start, right) };
-        vertices[vi++] = (Vertex){ .position = vec3_add(s.end, right) };
-        vertices[vi++] = (Vertex){ .position = vec3_sub(s.start, right) };
-        vertices[vi++] = (Vertex){ .position = vec3_sub(s.end, right) };
-        indices[ii++] = r + 0;
-        indices[ii++] = r + 1;
-        indices[ii++] = r + 2;
-        indices[ii++] = r + 1;
-        indices[ii++] = r + 2;
-        indices[ii++] = r + 3;
+
+        if (s.type == PST_Circle) {
+            vec3s center = vec3_scale(vec3_add(s.start, s.end), 0.5f);
+            vec3s axes[PLANT_CIRCLE_VERTICES] = { GLMS_XUP, GLMS_YUP, GLMS_ZUP, vec3_negate(GLMS_XUP), vec3_negate(GLMS_YUP), vec3_negate(GLMS_ZUP) };
+            for (u32 k = 0; k < PLANT_CIRCLE_VERTICES; k++) {
+                vertices[vi + k] = (Vertex){ .position = vec3_add(center, vec3_scale(axes[k], 0.5f * s.width)), .normal = axes[k] };
+            }
+            // x y z -x -y -z, four faces around each pole
+            u32 faces[PLANT_CIRCLE_INDICES] = { 0,1,2, 2,1,3, 3,1,5, 5,1,0, 2,4,0, 3,4,2, 5,4,3, 0,4,5 };
+            for (u32 k = 0; k < PLANT_CIRCLE_INDICES; k++) indices[ii++] = (u16)(vi + faces[k]);
+            vi += PLANT_CIRCLE_VERTICES;
+            continue;
+        }
+
+        vec3s axis = vec3_sub(s.end, s.start);
+        f32 length = vec3_norm(axis);
+        vec3s dir = length > 1e-6f ? vec3_divs(axis, length) : GLMS_YUP;
+        // normals lean along the branch by how much it narrows
+        f32 slope = length > 1e-6f ? 0.5f * (s.width - s.end_width) / length : 0.0f;
+
+        u32 bottom;
+        vec3s right;
+        if (s.parent != PLANT_NO_PARENT) {
+            PlantRing* parent = &rings[s.parent];
+            bottom = parent->first;
+            right = vec3_normalize(quat_rotatev(quat_from_vecs(parent->dir, dir), parent->right));
+        } else {
+            right = vec3_normalize(vec3_ortho(dir));
+            bottom = vi;
+            vi = plant_write_ring(vertices, vi, radial, s.start, 0.5f * s.width, dir, right, slope);
+        }
+
+        u32 top = vi;
+        vi = plant_write_ring(vertices, vi, radial, s.end, 0.5f * s.end_width, dir, right, slope);
+        rings[i] = (PlantRing){ .first = top, .dir = dir, .right = right };
+
+        for (u32 k = 0; k < radial; k++) {
+            u32 next = (k + 1) % radial;
+            u32 quad[6] = { bottom + k, bottom + next, top + next, bottom + k, top + next, top + k };
+            for (u32 q = 0; q < 6; q++) indices[ii++] = (u16)quad[q];
+        }
     }
 
+    PROFILE_END();
     return (PlantMesh) {
-        .vertices = slice_to(vertices, n_vertices),
-        .indices = slice_to(indices, n_indices)
+        .vertices = slice_to(vertices, size.n_vertices),
+        .indices = slice_to(indices, size.n_indices),
     };
 }
+
+PlantMesh plant_meshify(PlantTemplate* plant, u32 radial, Allocator* allocator) {
+    PlantMeshSize size = plant_mesh_size(plant, radial);
+    Vertex* vertices = mrw_alloc_n(allocator, Vertex, max(size.n_vertices, 1u));
+    u16* indices = mrw_alloc_n(allocator, u16, max(size.n_indices, 1u));
+    PlantRing* rings = mrw_alloc_n(allocator, PlantRing, max(plant->n_shapes, 1u));
+    return plant_meshify_into(plant, size, vertices, indices, rings);
+}
+
+// n variants of one config, each from its own seed. every variant runs the
+// same ops so they all have the same shapes and mesh size, which lets everything
+// be allocated up front and the variants built in parallel jobs that don't
+// allocate. the templates are cached on disk keyed by plant_library_hash, a
+// hit skips expansion, compiling and evaluation and only meshes
+STRUCT(PlantLibrary) {
+    u64 hash;
+    u32 n_variants;
+    u32 n_shapes;
+    PlantTemplate* variants;
+    PlantMesh* meshes;
+    bool cached;
+};
+
+#define PLANT_VARIANTS 16
+
+#define PLANT_CACHE_MAGIC 0x544e4c50u // "PLNT"
+#define PLANT_CACHE_VERSION 2u
+
+STRUCT(PlantCacheHeader) {
+    u32 magic;
+    u32 version;
+    u64 hash;
+    u32 n_variants;
+    u32 n_shapes;
+};
+
+// covers everything that changes the templates, including their layout
+u64 plant_library_hash(PlantConfig* config, u32 n_variants, u64 seed) {
+    u64 hash = HASH_INIT;
+    u32 layout[] = { PLANT_CACHE_VERSION, sizeof(PlantShape), n_variants, config->iterations };
+    hash = hash_bytes(hash, layout, sizeof(layout));
+    hash = hash_bytes(hash, &seed, sizeof(seed));
+    // templates are cached after plant_normalize
+    f32 height = PLANT_HEIGHT;
+    hash = hash_bytes(hash, &height, sizeof(height));
+    hash = hash_bytes(hash, &config->default_angle, sizeof(config->default_angle));
+    hash = hash_bytes(hash, &config->first_shape, sizeof(config->first_shape));
+    hash = hash_bytes(hash, config->initial.start, slice_size(config->initial));
+    for (u32 symbol = 0; symbol < 256; symbol++) {
+        if (config->has_rule[symbol]) {
+            hash = hash_bytes(hash, &symbol, sizeof(symbol));
+            hash = hash_bytes(hash, config->rules[symbol].start, slice_size(config->rules[symbol]));
+        }
+        if (config->shapes[symbol].defined) {
+            PlantShapeConfig* shape = &config->shapes[symbol];
+            f32 values[] = { shape->width, shape->length, shape->angle, shape->taper, shape->size, shape->color.x, shape->color.y, shape->color.z };
+            hash = hash_bytes(hash, &symbol, sizeof(symbol));
+            hash = hash_bytes(hash, &shape->type, sizeof(shape->type));
+            hash = hash_bytes(hash, values, sizeof(values));
+        }
+    }
+    return hash;
+}
+
+static void plant_cache_path(char* path, usize size, u64 hash) {
+    snprintf(path, size, "./flos_plants_%016llx.bin", (unsigned long long)hash);
+}
+
+// meshing indexes rings by parent, a shape has to come after its parent and
+// be a type plant_meshify knows. every variant is sized like the first, so
+// their parents and types have to match it too
+static bool plant_cache_valid(PlantLibrary* library) {
+    for (u32 v = 0; v < library->n_variants; v++) {
+        PlantShape* first = library->variants[0].shapes;
+        PlantShape* shapes = library->variants[v].shapes;
+        for (u32 i = 0; i < library->n_shapes; i++) {
+            PlantShape* s = &shapes[i];
+            if (s->parent != PLANT_NO_PARENT && s->parent >= i) return false;
+            if (s->type != PST_Branch && s->type != PST_Circle) return false;
+            if (s->parent != first[i].parent || s->type != first[i].type) return false;
+        }
+    }
+    return true;
+}
+
+static bool plant_cache_load(PlantLibrary* library, Allocator* allocator) {
+    char path[64];
+    plant_cache_path(path, sizeof(path), library->hash);
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return false;
+
+    fseek(fp, 0, SEEK_END);
+    i64 file_size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    // a damaged header could ask for any amount, the shapes have to fit in the file
+    PlantCacheHeader header = { 0 };
+    bool ok = fread(&header, sizeof(header), 1, fp) == 1 &&
+        header.magic == PLANT_CACHE_MAGIC &&
+        header.version == PLANT_CACHE_VERSION &&
+        header.hash == library->hash &&
+        header.n_variants == library->n_variants &&
+        (u64)header.n_variants * header.n_shapes * sizeof(PlantShape) <= (u64)max(file_size, (i64)0) - sizeof(header);
+
+    if (ok) {
+        usize n = (usize)header.n_variants * header.n_shapes;
+        PlantShape* shapes = mrw_alloc_n(allocator, PlantShape, max(n, (usize)1));
+        ok = fread(shapes, sizeof(PlantShape), n, fp) == n;
+        library->n_shapes = header.n_shapes;
+        for (u32 v = 0; v < library->n_variants; v++) {
+            library->variants[v] = (PlantTemplate){ .shapes = shapes + (usize)v * header.n_shapes, .n_shapes = header.n_shapes };
+        }
+    }
+
+    fclose(fp);
+    return ok && plant_cache_valid(library);
+}
+
+static void plant_cache_save(PlantLibrary* library) {
+    char path[64];
+    plant_cache_path(path, sizeof(path), library->hash);
+    FILE* fp = fopen(path, "wb");
+    if (!fp) {
+        mrw_debug("plants: couldn't write {}", path);
+        return;
+    }
+
+    PlantCacheHeader header = {
+        .magic = PLANT_CACHE_MAGIC,
+        .version = PLANT_CACHE_VERSION,
+        .hash = library->hash,
+        .n_variants = library->n_variants,
+        .n_shapes = library->n_shapes,
+    };
+    fwrite(&header, sizeof(header), 1, fp);
+    // variants are contiguous, see plant_library
+    if (library->n_variants) fwrite(library->variants[0].shapes, sizeof(PlantShape), (usize)library->n_variants * library->n_shapes, fp);
+    fclose(fp);
+}
+
+STRUCT(PlantLibraryBuild) {
+    PlantConfig* config;
+    PlantProgram* program;
+    PlantLibrary* library;
+    u64 seed;
+
+    PlantShape* shapes;
+    PlantTurtle* stacks;
+
+    PlantMeshSize size;
+    Vertex* vertices;
+    u16* indices;
+    PlantRing* rings;
+};
+
+static void plant_library_evaluate_job(void* data, u32 start, u32 end) {
+    PlantLibraryBuild* build = data;
+    for (u32 v = start; v < end; v++) {
+        PlantTemplate* plant = &build->library->variants[v];
+        *plant = plant_evaluate_into(build->config, build->program,
+            hash_bytes(build->seed, &v, sizeof(v)),
+            build->shapes + (usize)v * build->program->n_draws,
+            build->stacks + (usize)v * max(build->program->max_depth, 1u));
+        plant_normalize(plant, PLANT_HEIGHT);
+    }
+}
+
+static void plant_library_meshify_job(void* data, u32 start, u32 end) {
+    PlantLibraryBuild* build = data;
+    PlantMeshSize size = build->size;
+    for (u32 v = start; v < end; v++) {
+        build->library->meshes[v] = plant_meshify_into(&build->library->variants[v], size,
+            build->vertices + (usize)v * size.n_vertices,
+            build->indices + (usize)v * size.n_indices,
+            build->rings + (usize)v * build->library->n_shapes);
+    }
+}
+
+PlantLibrary plant_library(PlantConfig* config, u32 n_variants, u64 seed, bool use_cache, Allocator* allocator) {
+    PROFILE_BEGIN("plant_library");
+
+    PlantLibrary library = {
+        .hash = plant_library_hash(config, n_variants, seed),
+        .n_variants = n_variants,
+        .variants = mrw_alloc_n(allocator, PlantTemplate, max(n_variants, 1u)),
+        .meshes = mrw_alloc_n(allocator, PlantMesh, max(n_variants, 1u)),
+    };
+    PlantLibraryBuild build = { .config = config, .library = &library, .seed = seed };
+    JobCounter counter = { 0 };
+
+    library.cached = use_cache && plant_cache_load(&library, allocator);
+    if (!library.cached) {
+        PlantProgram program = plant_program(config, allocator);
+        build.program = &program;
+        build.shapes = mrw_alloc_n(allocator, PlantShape, max((usize)n_variants * program.n_draws, (usize)1));
+        build.stacks = mrw_alloc_n(allocator, PlantTurtle, (usize)n_variants * max(program.max_depth, 1u));
+        library.n_shapes = program.n_draws;
+
+        jobs_parallel_for(&counter, "plant_library_evaluate_job", n_variants, 1, plant_library_evaluate_job, &build);
+        job_wait(&counter);
+
+        if (use_cache) plant_cache_save(&library);
+    }
+
+    build.size = n_variants ? plant_mesh_size(&library.variants[0], config->radial_segments) : (PlantMeshSize){ 0 };
+    build.vertices = mrw_alloc_n(allocator, Vertex, max((usize)n_variants * build.size.n_vertices, (usize)1));
+    build.indices = mrw_alloc_n(allocator, u16, max((usize)n_variants * build.size.n_indices, (usize)1));
+    build.rings = mrw_alloc_n(allocator, PlantRing, max((usize)n_variants * library.n_shapes, (usize)1));
+    jobs_parallel_for(&counter, "plant_library_meshify_job", n_variants, 1, plant_library_meshify_job, &build);
+    job_wait(&counter);
+
+    PROFILE_END();
+    return library;
+}
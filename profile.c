@@ -0,0 +1,150 @@
+#define FLOS_PROFILE_ZONES
+#include "base.c"
+
+// scoped profiler zones, compiled in with -DFLOS_PROFILE=ON
+//
+//     PROFILE_ZONE("name") {
+//         ...
+//     }
+//
+// don't break/return out of a zone block, the end timestamp would be skipped.
+// PROFILE_BEGIN/PROFILE_END are there for spans that don't fit a block.
+// PROFILE_COUNTER(name, series, value) samples a value, every series of the
+// same name ends up as one line on a shared counter track.
+// every thread records into its own ring buffer, profile_dump writes all of
+// them out as chrome trace-event json (chrome://tracing, ui.perfetto.dev)
+
+#ifdef FLOS_PROFILE
+
+#include <stdatomic.h>
+
+#define PROFILE_RING_SIZE (1u << 16)
+#define PROFILE_MAX_DEPTH 64
+#define PROFILE_MAX_THREADS 64
+
+STRUCT(ProfileEvent) {
+    cstr name;
+    f64 start;
+    f64 end;
+
+    bool counter;
+    u32 series;
+    f64 value;
+};
+
+STRUCT(ProfileThread) {
+    u32 id;
+    u64 head;
+    ProfileEvent events[PROFILE_RING_SIZE];
+
+    u32 depth;
+    ProfileEvent open[PROFILE_MAX_DEPTH];
+};
+
+struct {
+    f64 start;
+    ProfileThread* threads[PROFILE_MAX_THREADS];
+    atomic_uint n_threads;
+} profile = { 0 };
+
+static _Thread_local ProfileThread* profile_thread = nullptr;
+
+static ProfileThread* profile_get_thread(void) {
+    if (profile_thread) return profile_thread;
+
+    u32 id = atomic_fetch_add(&profile.n_threads, 1);
+    if (id >= PROFILE_MAX_THREADS) return nullptr;
+
+    profile_thread = mrw_alloc(memory.stable, ProfileThread);
+    *profile_thread = (ProfileThread){ .id = id };
+    profile.threads[id] = profile_thread;
+    return profile_thread;
+}
+
+void profile_init(void) {
+    profile.start = time_now();
+}
+
+void profile_begin(cstr name) {
+    ProfileThread* thread = profile_get_thread();
+    if (!thread || thread->depth >= PROFILE_MAX_DEPTH) return;
+    thread->open[thread->depth++] = (ProfileEvent){ .name = name, .start = time_now() };
+}
+
+void profile_end(void) {
+    ProfileThread* thread = profile_get_thread();
+    if (!thread || thread->depth == 0) return;
+    ProfileEvent event = thread->open[--thread->depth];
+    event.end = time_now();
+    thread->events[thread->head++ % PROFILE_RING_SIZE] = event;
+}
+
+void profile_counter(cstr name, u32 series, f64 value) {
+    ProfileThread* thread = profile_get_thread();
+    if (!thread) return;
+    thread->events[thread->head++ % PROFILE_RING_SIZE] = (ProfileEvent){
+        .name = name,
+        .start = time_now(),
+        .counter = true,
+        .series = series,
+        .value = value,
+    };
+}
+
+void profile_dump(cstr path) {
+    FILE* fp = fopen(path, "wb");
+    if (!fp) {
+        mrw_debug("profile: couldn't open {}", path);
+        return;
+    }
+
+    fprintf(fp, "{\"traceEvents\":[\n");
+    bool first = true;
+    u32 n_threads = min(atomic_load(&profile.n_threads), (u32)PROFILE_MAX_THREADS);
+    for (u32 t = 0; t < n_threads; t++) {
+        ProfileThread* thread = profile.threads[t];
+        if (!thread) continue;
+
+        u64 n = min(thread->head, (u64)PROFILE_RING_SIZE);
+        for (u64 i = thread->head - n; i < thread->head; i++) {
+            ProfileEvent event = thread->events[i % PROFILE_RING_SIZE];
+            if (event.counter) {
+                fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"C\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"args\":{\"%u\":%g}}",
+                    first ? "" : ",\n",
+                    event.name,
+                    thread->id,
+                    (event.start - profile.start) * 1e6,
+                    event.series,
+                    event.value);
+                first = false;
+                continue;
+            }
+            fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                first ? "" : ",\n",
+                event.name,
+                thread->id,
+                (event.start - profile.start) * 1e6,
+                (event.end - event.start) * 1e6);
+            first = false;
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+}
+
+#define PROFILE_BEGIN(name) profile_begin(name)
+#define PROFILE_END() profile_end()
+#define PROFILE_ZONE(name) for (bool _profile_zone = (profile_begin(name), true); _profile_zone; _profile_zone = (profile_end(), false))
+#define PROFILE_COUNTER(name, series, value) profile_counter(name, series, value)
+
+#else // FLOS_PROFILE
+
+static inline void profile_init(void) { }
+static inline void profile_dump(cstr path) { }
+
+#define PROFILE_BEGIN(name)
+#define PROFILE_END()
+#define PROFILE_ZONE(name)
+#define PROFILE_COUNTER(name, series, value) ((void)(series), (void)(value))
+
+#endif // FLOS_PROFILE
@@ -1,13 +1,84 @@
 #define FLOS_RENDER
 #include "base.c"
 
+// every entity drawn with a mesh owns a slot in its persistent instance
+// buffer. instance_data mirrors the whole buffer, only slots marked dirty are
+// uploaded, the buffer is rewritten in full only when it had to grow
+//
+// nothing is drawn straight from the slots, render_cull_instances builds a
+// list of the visible ones every frame and the shaders read their instance
+// through it
 STRUCT(Mesh) {
     ReniBuffer vertex_buffer;
     ReniBuffer index_buffer;
     ReniBuffer instance_buffer;
     VEKTOR(u8) instance_data;
+    usize slot_size;
+
+    // slots hold PlanetInstances, every shell is drawn as its own instance
+    bool planet;
+
+    // bounding sphere in mesh space, xyz center and w radius
+    vec4s bound;
+    ReniBuffer visible_buffer;
+    ReniBinding binding;
+    u32 n_visible;
+
+    u32 n_slots;
+    u32 n_slots_allocated;
+    // size of the gpu buffer in slots as of the last full write
+    u32 n_slots_uploaded;
+
+    VEKTOR(u32) free_slots;
+    u32 n_free;
+    u32 n_free_allocated;
+
+    VEKTOR(u32) dirty_slots;
+    u32 n_dirty;
+    VEKTOR(u8) slot_dirty;
+    // behind the planet the slot's entity stands on, set every frame by
+    // render_cull_horizon and skipped when the visible list is built
+    VEKTOR(u8) slot_hidden;
+
     u32 n_instances;
-    u32 shader;
+    u32 n_indices;
+    ShaderHandle shader;
+    // order in the render queue's sort keys
+    u32 id;
+    // binding in the sort keys, the owner's id for shared meshes
+    u32 binding_id;
+
+    // drawn with every visible instance of another mesh, terrain chunks all
+    // share their planet's. only the vertex and index buffers are its own, so
+    // any number of them costs a single binding switch
+    bool shared;
+    MeshHandle instances;
+    // shared meshes have no entity, their owner hides them directly
+    bool hidden;
+};
+
+// same layout as VisibleList in common.wgsl. first_shell is the sum of
+// n_shells over the visible planets before this one
+STRUCT(RenderVisibleInstance) {
+    u32 slot;
+    u32 first_shell;
+};
+
+STRUCT(RenderVisibleList) {
+    u32 count;
+    RenderVisibleInstance entries[];
+};
+
+// grass height relative to the radius, same as the offset in planet.wgsl
+#define PLANET_SHELL_HEIGHT 0.05f
+
+STRUCT(RenderCullStats) {
+    u32 n_tested;
+    u32 n_visible;
+    // children of planets tested against the horizon and found behind it.
+    // the frustum can drop them too, they're counted once in n_visible
+    u32 n_horizon_tested;
+    u32 n_horizon_culled;
 };
 
 STRUCT(AtmospherePlanet) {
@@ -21,6 +92,12 @@ cstr common_includes[] = {
 
 typedef GENARR_ITER_ALIAS(Mesh, mesh) MeshIter;
 
+// passes in submission order, the top bits of a render queue key
+typedef enum {
+    RP_Meshes,
+    RP_Atmosphere,
+} RenderPassId;
+
 struct {
     u32 width, height;
     Reni* reni;
@@ -46,63 +123,194 @@ struct {
         ReniTexture texture;
     } depth;
 
+    // group 1 of the plant and planet shaders, instances and the visible list
+    struct {
+        ReniBindingLayout layout;
+    } instances;
+
     struct {
-        ReniShader shader;
+        RenderCullStats stats;
+    } cull;
+
+    struct {
+        ShaderHandle shader;
+        MeshHandle lods[PLANET_LOD_LEVELS];
+        bool has_lods;
     } planets;
 
     struct {
-        ReniShader shader;
+        ShaderHandle shader;
     } plants;
 
     struct {
         ReniBindingLayout layout;
         ReniBinding binding;
         ReniBuffer buffer;
-        ReniShader shader;
+        ShaderHandle shader;
+        u32 id;
     } atmosphere;
 
     GENARR(Mesh) meshes;
 
+    RenderQueue queue;
+    u32 n_ids;
+
     RippleContext ripple_context;
 } renderer = { 0 };
 
-MeshHandle render_mesh_create(u8Slice vertices, u8Slice indices, usize instance_size, u32 shader) {
+void render_buffer_write(ReniBuffer buffer, u8Slice data, usize offset) {
+#ifdef FLOS_HEADLESS
+    render_null_record((RenderNullCommand){ .type = RNC_BufferWrite, .n_bytes = slice_size(data) });
+#else // FLOS_HEADLESS
+    PROFILE_ZONE("reni_buffer_write") reni_buffer_write(renderer.reni, buffer, data, offset);
+#endif // FLOS_HEADLESS
+}
+
+// center of the vertices' box and the farthest vertex from it
+static vec4s render_mesh_bound(u8Slice vertices) {
+    Vertex* v = (Vertex*)vertices.start;
+    usize n = slice_size(vertices) / sizeof(Vertex);
+    if (!n) return (vec4s){ 0 };
+
+    vec3s lo = v[0].position, hi = v[0].position;
+    for (usize i = 1; i < n; i++) {
+        lo = vec3_minv(lo, v[i].position);
+        hi = vec3_maxv(hi, v[i].position);
+    }
+    vec3s center = vec3_scale(vec3_add(lo, hi), 0.5f);
+
+    f32 radius = 0.0f;
+    for (usize i = 0; i < n; i++) {
+        radius = max(radius, vec3_distance2(center, v[i].position));
+    }
+    radius = sqrtf(radius);
+
+    return (vec4s){ .x = center.x, .y = center.y, .z = center.z, .w = radius };
+}
+
+// indices are u16, reni takes no others
+MeshHandle render_mesh_create(u8Slice vertices, u8Slice indices, usize instance_size, ShaderHandle shader) {
     Mesh mesh = (Mesh) {
-        .vertex_buffer = reni_create_buffer(renderer.reni, (ReniBufferConfig) {  .data = vertices, .usage = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Vertex  }),
-        .index_buffer = reni_create_buffer(renderer.reni, (ReniBufferConfig) {  .data = indices, .usage = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Index  }),
-        .instance_buffer = reni_create_buffer(renderer.reni, (ReniBufferConfig) {  .usage = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Vertex  }),
+        .n_indices = slice_size(indices) / sizeof(u16),
         .shader = shader,
+        .slot_size = instance_size,
+        .planet = shader.index == renderer.planets.shader.index,
+        .id = renderer.n_ids,
+        .binding_id = renderer.n_ids++,
     };
+    mesh.bound = render_mesh_bound(vertices);
     vektor_init(mesh.instance_data, 1, memory.stable);
+    vektor_init(mesh.free_slots, 1, memory.stable);
+    vektor_init(mesh.dirty_slots, 1, memory.stable);
+    vektor_init(mesh.slot_dirty, 1, memory.stable);
+    vektor_init(mesh.slot_hidden, 1, memory.stable);
+
+#ifndef FLOS_HEADLESS
+    mesh.vertex_buffer = reni_create_buffer(renderer.reni, (ReniBufferConfig) {  .data = vertices, .usage = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Vertex  });
+    mesh.index_buffer = reni_create_buffer(renderer.reni, (ReniBufferConfig) {  .data = indices, .usage = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Index  });
+    mesh.instance_buffer = reni_create_buffer(renderer.reni, (ReniBufferConfig) {  .usage = ReniBufferUsage_CopyDst | ReniBufferUsage_Storage  });
+    mesh.visible_buffer = reni_create_buffer(renderer.reni, (ReniBufferConfig) {  .usage = ReniBufferUsage_CopyDst | ReniBufferUsage_Storage  });
+    mesh.binding = reni_create_binding(renderer.reni, (ReniBindingConfig) {
+        .name = sstr("mesh instances"),
+        .layout = renderer.instances.layout,
+        .entries[0].buffer.buffer = mesh.instance_buffer,
+        .entries[1].buffer.buffer = mesh.visible_buffer
+    });
+#endif // FLOS_HEADLESS
     return genarr_add(renderer.meshes, mesh);
 }
 
-void render_mesh_re_create(MeshHandle old, u8Slice vertices, u8Slice indices, usize instance_size, u32 shader) {
+// instances without geometry of their own, drawn only through the meshes
+// sharing them. bound has to cover every one of those
+MeshHandle render_mesh_create_instances(vec4s bound, usize instance_size, ShaderHandle shader) {
+    MeshHandle handle = render_mesh_create((u8Slice){ 0 }, (u8Slice){ 0 }, instance_size, shader);
+    genarr_get(renderer.meshes, handle)->bound = bound;
+    return handle;
+}
+
+MeshHandle render_mesh_create_shared(u8Slice vertices, u8Slice indices, MeshHandle instances) {
+    Mesh* owner = genarr_get(renderer.meshes, instances);
+    Mesh mesh = (Mesh) {
+        .n_indices = slice_size(indices) / sizeof(u16),
+        .shader = owner->shader,
+        .slot_size = owner->slot_size,
+        .planet = owner->planet,
+        .id = renderer.n_ids++,
+        .binding_id = owner->binding_id,
+        .shared = true,
+        .instances = instances,
+    };
+    mesh.bound = render_mesh_bound(vertices);
+    vektor_init(mesh.instance_data, 1, memory.stable);
+    vektor_init(mesh.free_slots, 1, memory.stable);
+    vektor_init(mesh.dirty_slots, 1, memory.stable);
+    vektor_init(mesh.slot_dirty, 1, memory.stable);
+    vektor_init(mesh.slot_hidden, 1, memory.stable);
+
+#ifndef FLOS_HEADLESS
+    mesh.vertex_buffer = reni_create_buffer(renderer.reni, (ReniBufferConfig) {  .data = vertices, .usage = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Vertex  });
+    mesh.index_buffer = reni_create_buffer(renderer.reni, (ReniBufferConfig) {  .data = indices, .usage = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Index  });
+    mesh.binding = owner->binding;
+#endif // FLOS_HEADLESS
+    return genarr_add(renderer.meshes, mesh);
+}
+
+void render_mesh_set_hidden(MeshHandle handle, bool hidden) {
+    genarr_get(renderer.meshes, handle)->hidden = hidden;
+}
+
+void render_mesh_re_create(MeshHandle old, u8Slice vertices, u8Slice indices, usize instance_size, ShaderHandle shader) {
     Mesh* mesh = genarr_get(renderer.meshes, old);
-    reni_buffer_write(renderer.reni, mesh->vertex_buffer, vertices, 0);
-    reni_buffer_write(renderer.reni, mesh->index_buffer, indices, 0);
+    mesh->n_indices = slice_size(indices) / sizeof(u16);
     mesh->shader = shader;
+    mesh->bound = render_mesh_bound(vertices);
+    render_buffer_write(mesh->vertex_buffer, vertices, 0);
+    render_buffer_write(mesh->index_buffer, indices, 0);
 }
 
 void render_mesh_free(MeshHandle handle) {
     Mesh* mesh = genarr_get(renderer.meshes, handle);
 
+#ifndef FLOS_HEADLESS
     reni_release_buffer(renderer.reni, mesh->vertex_buffer);
     reni_release_buffer(renderer.reni, mesh->index_buffer);
-    reni_release_buffer(renderer.reni, mesh->instance_buffer);
+    if (!mesh->shared) {
+        reni_release_buffer(renderer.reni, mesh->instance_buffer);
+        reni_release_buffer(renderer.reni, mesh->visible_buffer);
+    }
+#endif // FLOS_HEADLESS
     vektor_free(mesh->instance_data);
+    vektor_free(mesh->free_slots);
+    vektor_free(mesh->dirty_slots);
+    vektor_free(mesh->slot_dirty);
+    vektor_free(mesh->slot_hidden);
 
     genarr_remove(renderer.meshes, handle);
 }
 
+void render_init_instances(void) {
+    renderer.instances.layout = shaders_create_binding_layout(renderer.reni, (ReniBindingLayoutConfig){
+       .name = sstr("mesh instances layout"),
+       .entries[0] = {
+           .visibility = ReniShaderStage_Vertex,
+           .buffer.type = ReniBufferBindingType_ReadOnlyStorage
+       },
+       .entries[1] = {
+           .visibility = ReniShaderStage_Vertex,
+           .buffer.type = ReniBufferBindingType_ReadOnlyStorage
+       },
+    });
+}
+
 void render_init_planets(void) {
-    renderer.planets.shader = reni_create_shader(renderer.reni, (ReniShaderConfig){
+    shaders_register(renderer.reni, renderer.planets.shader, (ReniShaderConfig){
         .name = sstr("planet shader"),
         .source.file = {
             .path = "./res/shaders/planet.wgsl",
             .includes = array_slice(common_includes)
         },
         .layouts[0] = renderer.shader_data.layout,
+        .layouts[1] = renderer.instances.layout,
         .vertex = {
             .entry = sstr("vs_main"),
             .buffers[0] = {
@@ -117,40 +325,6 @@ void render_init_planets(void) {
                     .offset = offsetof(Vertex, normal),
                     .format = ReniVertexFormat_Float32x3,
                 }
-            },
-            .buffers[1] = {
-                .instance = true,
-                .stride = sizeof(PlanetInstance),
-                .attributes[0] = {
-                    .location = 3,
-                    .format = ReniVertexFormat_Float32x4,
-                    .offset = offsetof(PlanetInstance, mat.col[0])
-                },
-                .attributes[1] = {
-                    .location = 4,
-                    .format = ReniVertexFormat_Float32x4,
-                    .offset = offsetof(PlanetInstance, mat.col[1])
-                },
-                .attributes[2] = {
-                    .location = 5,
-                    .format = ReniVertexFormat_Float32x4,
-                    .offset = offsetof(PlanetInstance, mat.col[2])
-                },
-                .attributes[3] = {
-                    .location = 6,
-                    .format = ReniVertexFormat_Float32x4,
-                    .offset = offsetof(PlanetInstance, mat.col[3])
-                },
-                .attributes[4] = {
-                    .location = 7,
-                    .format = ReniVertexFormat_Float32,
-                    .offset = offsetof(PlanetInstance, shell_t)
-                },
-                .attributes[5] = {
-                    .location = 8,
-                    .format = ReniVertexFormat_Float32,
-                    .offset = offsetof(PlanetInstance, scale)
-                }
             }
         },
         .fragment = {
@@ -168,13 +342,14 @@ void render_init_planets(void) {
 }
 
 void render_init_plants(void) {
-    renderer.plants.shader = reni_create_shader(renderer.reni, (ReniShaderConfig){
+    shaders_register(renderer.reni, renderer.plants.shader, (ReniShaderConfig){
         .name = sstr("plant shader"),
         .source.file = {
             .path = "./res/shaders/plant.wgsl",
             .includes = array_slice(common_includes)
         },
         .layouts[0] = renderer.shader_data.layout,
+        .layouts[1] = renderer.instances.layout,
         .vertex = {
             .entry = sstr("vs_main"),
             .buffers[0] = {
@@ -189,30 +364,6 @@ void render_init_plants(void) {
                     .offset = offsetof(Vertex, normal),
                     .format = ReniVertexFormat_Float32x3,
                 }
-            },
-            .buffers[1] = {
-                .instance = true,
-                .stride = sizeof(Instance),
-                .attributes[0] = {
-                    .location = 3,
-                    .format = ReniVertexFormat_Float32x4,
-                    .offset = offsetof(PlanetInstance, mat.col[0])
-                },
-                .attributes[1] = {
-                    .location = 4,
-                    .format = ReniVertexFormat_Float32x4,
-                    .offset = offsetof(PlanetInstance, mat.col[1])
-                },
-                .attributes[2] = {
-                    .location = 5,
-                    .format = ReniVertexFormat_Float32x4,
-                    .offset = offsetof(PlanetInstance, mat.col[2])
-                },
-                .attributes[3] = {
-                    .location = 6,
-                    .format = ReniVertexFormat_Float32x4,
-                    .offset = offsetof(PlanetInstance, mat.col[3])
-                }
             }
         },
         .fragment = {
@@ -230,7 +381,7 @@ void render_init_plants(void) {
 }
 
 void render_init_atmosphere(void) {
-    renderer.atmosphere.layout = reni_create_binding_layout(renderer.reni, (ReniBindingLayoutConfig){
+    renderer.atmosphere.layout = shaders_create_binding_layout(renderer.reni, (ReniBindingLayoutConfig){
        .name = sstr("atmosphere bindinding layout"),
        .entries[0] = {
            .visibility = ReniShaderStage_Fragment,
@@ -242,7 +393,7 @@ void render_init_atmosphere(void) {
        },
     });
 
-    renderer.atmosphere.shader = reni_create_shader(renderer.reni, (ReniShaderConfig){
+    shaders_register(renderer.reni, renderer.atmosphere.shader, (ReniShaderConfig){
         .name = sstr("atmosphere shader"),
         .source.file = {
             .path = "./res/shaders/atmosphere.wgsl",
@@ -279,9 +430,38 @@ void render_init_atmosphere(void) {
 static void render_error_callback(str msg)
 {
     mrw_debug("Render error: {}", msg);
+    shaders_build_error();
+}
+
+// one planet mesh per lod, planets are moved between them by render_select_planet_lods
+void render_set_planet_lods(MeshHandle lods[PLANET_LOD_LEVELS]) {
+    buf_copy(renderer.planets.lods, lods, sizeof(renderer.planets.lods));
+    renderer.planets.has_lods = true;
 }
 
 void render_init(void) {
+    renderer.shader_data.data.atmosphere_height = 1.2f;
+    renderer.shader_data.data.atmosphere_density = 1.1f;
+    renderer.shader_data.data.atmosphere_falloff = 2.7f;
+
+    renderer.ripple_context = ripple_initialize((RippleBackendRendererConfig){0});
+    // renderer.ripple_context = ripple_initialize((RippleBackendRendererConfig){
+    //     .reni = renderer.reni
+    // });
+    ripple_make_active_context(&renderer.ripple_context);
+
+    render_queue_init(&renderer.queue);
+    renderer.atmosphere.id = renderer.n_ids++;
+
+    renderer.plants.shader = shaders_find(str("plant"));
+    renderer.planets.shader = shaders_find(str("planet"));
+    renderer.atmosphere.shader = shaders_find(str("atmosphere"));
+
+#ifdef FLOS_HEADLESS
+    render_null_init();
+    renderer.width = window.width;
+    renderer.height = window.height;
+#else // FLOS_HEADLESS
     renderer.reni = reni_create_reni((ReniConfig){
         .name = sstr("Reni !"),
         .error_callback = render_error_callback,
@@ -292,6 +472,7 @@ void render_init(void) {
         window.window,
         .mode = ReniPresentMode_Mailbox
     });
+    shaders_init();
 
     renderer.depth.texture = reni_create_texture(renderer.reni, (ReniTextureConfig){
         .name = sstr("Depth texture"),
@@ -299,7 +480,7 @@ void render_init(void) {
         .usage = ReniTextureUsage_RenderAttachment | ReniTextureUsage_TextureBinding
     });
 
-    renderer.shader_data.layout = reni_create_binding_layout(renderer.reni, (ReniBindingLayoutConfig) {
+    renderer.shader_data.layout = shaders_create_binding_layout(renderer.reni, (ReniBindingLayoutConfig) {
         .entries[0] = {
             .visibility = ReniShaderStage_Vertex | ReniShaderStage_Fragment,
             .buffer.type = ReniBufferBindingType_Uniform,
@@ -317,103 +498,436 @@ void render_init(void) {
         .entries[0].buffer.buffer = renderer.shader_data.buffer
     });
 
-    renderer.shader_data.data.atmosphere_height = 1.2f;
-    renderer.shader_data.data.atmosphere_density = 1.1f;
-    renderer.shader_data.data.atmosphere_falloff = 2.7f;
-
+    render_init_instances();
     render_init_planets();
     render_init_plants();
     render_init_atmosphere();
 
     renderer.width = 0;
     renderer.height = 0;
+#endif // FLOS_HEADLESS
+}
 
-    renderer.ripple_context = ripple_initialize((RippleBackendRendererConfig){0});
-    // renderer.ripple_context = ripple_initialize((RippleBackendRendererConfig){
-    //     .reni = renderer.reni
-    // });
-    ripple_make_active_context(&renderer.ripple_context);
+static void render_instance_mark_dirty(Mesh* mesh, u32 slot) {
+    u8* slot_dirty = slice_vektor(mesh->slot_dirty).start;
+    if (slot_dirty[slot]) return;
+    slot_dirty[slot] = 1;
+    vektor_add(mesh->dirty_slots, slot);
+    mesh->n_dirty++;
+}
+
+// new slots are zeroed, a zero matrix collapses every vertex so unused slots draw nothing
+static u32 render_instance_alloc(Mesh* mesh) {
+    if (mesh->n_free) {
+        return slice_vektor(mesh->free_slots).start[--mesh->n_free];
+    }
+
+    if (mesh->n_slots == mesh->n_slots_allocated) {
+        u32 n_new = max(mesh->n_slots_allocated, 16u);
+        static const u8 zero_slot[sizeof(PlanetInstance)] = { 0 };
+        for (u32 i = 0; i < n_new; i++) {
+            vektor_add_arr(mesh->instance_data, slice_to((u8*)zero_slot, mesh->slot_size));
+            vektor_add(mesh->slot_dirty, (u8)0);
+            vektor_add(mesh->slot_hidden, (u8)0);
+        }
+        mesh->n_slots_allocated += n_new;
+    }
+
+    return mesh->n_slots++;
+}
+
+static void render_instance_free(Mesh* mesh, u32 slot) {
+    memset(slice_vektor(mesh->instance_data).start + slot * mesh->slot_size, 0, mesh->slot_size);
+    slice_vektor(mesh->slot_hidden).start[slot] = 0;
+    render_instance_mark_dirty(mesh, slot);
+
+    if (mesh->n_free == mesh->n_free_allocated) {
+        vektor_add(mesh->free_slots, slot);
+        mesh->n_free_allocated++;
+    }
+    else {
+        slice_vektor(mesh->free_slots).start[mesh->n_free] = slot;
+    }
+    mesh->n_free++;
+}
+
+// render_cull_horizon calls it every frame
+static void render_instance_set_hidden(Mesh* mesh, u32 slot, bool hidden) {
+    slice_vektor(mesh->slot_hidden).start[slot] = hidden;
+}
+
+static void render_instance_write(Mesh* mesh, u32 slot, struct TransformC* transform, struct PlanetC* planet) {
+    u8* data = slice_vektor(mesh->instance_data).start + slot * mesh->slot_size;
+    // render_cull_horizon sets it again if the entity still stands on a planet
+    slice_vektor(mesh->slot_hidden).start[slot] = 0;
+
+    if (mesh->planet) {
+        PlanetInstance* instance = (PlanetInstance*)data;
+        instance->mat = transform->_matrix;
+        instance->scale = transform->world.scale;
+        instance->n_shells = planet->lod_shells;
+    }
+    else {
+        ((Instance*)data)->mat = transform->_matrix;
+    }
+}
+
+// slots are handed out and marked dirty up front, only the copies into the
+// mirrors run as jobs. entities in the list all have distinct slots
+#define RENDER_INSTANCE_BATCH 1024
+
+STRUCT(RenderInstanceWrites) {
+    u32* indices;
+    struct TransformC* transforms;
+    struct MeshC* meshes;
+    struct PlanetC* planets;
+};
+
+static void render_instance_write_job(void* data, u32 start, u32 end) {
+    RenderInstanceWrites* writes = data;
+    for (u32 i = start; i < end; i++) {
+        u32 index = writes->indices[i];
+        struct MeshC* mesh = &writes->meshes[index];
+        render_instance_write(genarr_get(renderer.meshes, mesh->mesh), mesh->instance - 1, &writes->transforms[index], &writes->planets[index]);
+    }
+}
+
+#define RENDER_FOV 80.0f
+
+// smallest on screen radius in pixels each lod is used from, see planet_lod_subdivisions
+static const f32 planet_lod_radius[PLANET_LOD_LEVELS] = { 0.0f, 24.0f, 96.0f, 384.0f };
+// below this a planet isn't drawn at all
+#define PLANET_LOD_MIN_RADIUS 0.5f
+
+// shells less than a pixel apart don't add anything, so the shell count
+// follows how many pixels the grass is tall and the mesh follows the radius
+static void render_select_planet_lods(Scene* scene) {
+    PROFILE_BEGIN("render_select_planet_lods");
+
+    struct TransformC* camera = entity_transform(scene, scene->camera);
+    struct TransformC* transforms = scene_column(scene, transform);
+    struct PlanetC* planets = scene_column(scene, planet);
+    f32 pixels_per_unit = renderer.height * 0.5f / tanf(to_rad(RENDER_FOV) * 0.5f);
+
+    EntityIter iter = { .include = CT_Planet | CT_Mesh | CT_Transform };
+    while (scene_next_entity(scene, &iter)) {
+        struct Transform* world = &transforms[iter.index].world;
+        struct PlanetC* planet = &planets[iter.index];
+
+        f32 dist = vec3_distance(world->pos, camera->world.pos);
+        f32 radius = dist > world->scale ? world->scale / dist * pixels_per_unit : FLT_MAX;
+
+        u32 level = 0;
+        while (level + 1 < PLANET_LOD_LEVELS && radius >= planet_lod_radius[level + 1]) level++;
+
+        u32 shells = 0;
+        if (radius >= PLANET_LOD_MIN_RADIUS) {
+            shells = (u32)clamp(ceilf(radius * PLANET_SHELL_HEIGHT), 1.0f, (f32)max(planet->shells, 1u));
+        }
+
+        planet->lod_level = level;
+        MeshHandle lod = renderer.planets.lods[level];
+        // terrain planets keep the instances their chunks draw with
+        if (!planet->terrain && genarr_get(renderer.meshes, scene_column(scene, mesh)[iter.index].mesh) != genarr_get(renderer.meshes, lod)) {
+            entity_set_mesh(scene, iter.handle, lod);
+        }
+        if (shells != planet->lod_shells) {
+            planet->lod_shells = shells;
+            entity_instance_changed(scene, iter.handle);
+        }
+
+        PROFILE_COUNTER("planet lod level", iter.index, level);
+        PROFILE_COUNTER("planet lod shells", iter.index, shells);
+    }
+
+    PROFILE_END();
+}
+
+// a sphere (center, radius) is behind the horizon when every point of it is
+// further around the planet than the camera can see. a point at distance d
+// from the center is visible up to acos(r / d) on each side of the tangent
+// cone, so the sphere is hidden once its angle from the camera, minus its own
+// angular size, passes the camera's angle plus its top's
+static bool render_horizon_hidden(vec3s planet, f32 planet_radius, vec3s to_camera, f32 camera_angle, vec3s center, f32 radius) {
+    vec3s to_center = vec3_sub(center, planet);
+    f32 dist = vec3_norm(to_center);
+    if (dist <= radius) return false;
+
+    f32 cos_angle = vec3_dot(to_center, to_camera) / dist;
+    f32 angle = acosf(clamp(cos_angle, -1.0f, 1.0f));
+    f32 extent = asinf(radius / dist);
+    f32 top_angle = acosf(min(planet_radius / (dist + radius), 1.0f));
+
+    return angle - extent > camera_angle + top_angle;
+}
+
+// marks the direct children of every planet that the planet itself hides.
+// frustum culling can't catch these, standing on a planet half its plants are
+// in front of the camera but under the ground
+static void render_cull_horizon(Scene* scene) {
+    PROFILE_BEGIN("render_cull_horizon");
+
+    struct TransformC* camera = entity_transform(scene, scene->camera);
+    ComponentType* components = scene_column(scene, components);
+    struct TransformC* transforms = scene_column(scene, transform);
+    struct MeshC* meshes = scene_column(scene, mesh);
+    struct PlanetC* planets = scene_column(scene, planet);
+    u32 n_tested = 0, n_culled = 0;
+
+    EntityIter iter = { .include = CT_Planet | CT_Transform };
+    while (scene_next_entity(scene, &iter)) {
+        struct Transform* planet = &transforms[iter.index].world;
+        // only the lowest ground is sure to block the view, valleys of the
+        // terrain go down to 1 - TERRAIN_AMPLITUDE of the radius
+        f32 ground = planets[iter.index].terrain ? (1.0f - TERRAIN_AMPLITUDE) * planet->scale : planet->scale;
+        vec3s to_camera = vec3_sub(camera->world.pos, planet->pos);
+        f32 camera_dist = vec3_norm(to_camera);
+        // from inside the sphere nothing is past the horizon
+        bool inside = camera_dist <= ground;
+        f32 camera_angle = inside ? 0.0f : acosf(ground / camera_dist);
+        to_camera = vec3_scale(to_camera, inside ? 0.0f : 1.0f / camera_dist);
+
+        for_each_entity_children(scene, iter.handle, child) {
+            if (!meshes[child.index].instance || !scene_instance_visible(components[child.index])) continue;
+            Mesh* mesh = genarr_get(renderer.meshes, meshes[child.index].mesh);
+            struct TransformC* transform = &transforms[child.index];
+
+            vec3s bound = { .x = mesh->bound.x, .y = mesh->bound.y, .z = mesh->bound.z };
+            vec3s center = mat4_mulv3(transform->_matrix, bound, 1.0f);
+            bool hidden = !inside && render_horizon_hidden(planet->pos, ground, to_camera, camera_angle, center, mesh->bound.w * transform->world.scale);
+
+            render_instance_set_hidden(mesh, meshes[child.index].instance - 1, hidden);
+            n_tested++;
+            n_culled += hidden;
+        }
+    }
+
+    renderer.cull.stats.n_horizon_tested = n_tested;
+    renderer.cull.stats.n_horizon_culled = n_culled;
+    PROFILE_COUNTER("instances horizon culled", 0, n_culled);
+
+    PROFILE_END();
 }
 
-void render_render_meshes(Scene* scene, ReniTexture surface_texture) {
+// applies what the scene queued since the last frame to the instance mirrors,
+// entities that didn't move or change visibility cost nothing here
+void render_gather_instances(Scene* scene) {
+    PROFILE_BEGIN("render_gather_instances");
+
+    if (renderer.planets.has_lods) {
+        render_select_planet_lods(scene);
+    }
+
     {
-        MeshIter mesh_iter = { 0 };
-        while (genarr_next_valid(renderer.meshes, &mesh_iter)) {
-            mesh_iter.mesh->n_instances = 0;
-            vektor_clear(mesh_iter.mesh->instance_data);
+        SceneInstanceRelease* released = slice_vektor(scene->instances.released).start;
+        for (u32 i = 0; i < scene->instances.n_released; i++) {
+            Mesh* mesh = genarr_get(renderer.meshes, released[i].mesh);
+            if (!mesh) continue;
+            render_instance_free(mesh, released[i].slot);
         }
+        vektor_clear(scene->instances.released);
+        scene->instances.n_released = 0;
     }
 
     {
-        EntityIter iter = { .include = CT_Mesh | CT_Transform };
-        while (scene_next_entity(scene, &iter)) {
-            Entity* entity = iter.entity;
-            Mesh* mesh = genarr_get(renderer.meshes, entity->mesh.mesh);
-
-            if (entity_has(entity, CT_Planet)) {
-                PlanetInstance shells[16] = { 0 };
-                for (u32 i = 0; i < 16; i++) {
-                    shells[i] = (PlanetInstance){
-                        .mat = entity->transform._matrix,
-                        .shell_t = i / 15.0f,
-                        .scale = entity->transform.world.scale,
-                    };
-                    mesh->n_instances++;
-                }
+        ComponentType* components = scene_column(scene, components);
+        u8* flags = scene_column(scene, transform_flags);
+        struct TransformC* transforms = scene_column(scene, transform);
+        struct MeshC* meshes = scene_column(scene, mesh);
+        struct PlanetC* planets = scene_column(scene, planet);
+
+        // compacted in place down to the entries that still need writing
+        u32* changed = slice_vektor(scene->instances.changed).start;
+        u32 n_writes = 0;
+        for (u32 i = 0; i < scene->instances.n_changed; i++) {
+            u32 index = changed[i];
+            // cleared when the slot was destroyed or already handled this frame
+            if (!FLAG_HAS_ALL(flags[index], TF_InstanceQueued)) continue;
+            FLAG_CLEAR(flags[index], TF_InstanceQueued);
+            if (!scene_instance_visible(components[index])) continue;
 
-                u8Slice slice = slice_to((u8*)shells, array_size(shells));
-                vektor_add_arr(mesh->instance_data, slice);
-                continue;
+            Mesh* mesh = genarr_get(renderer.meshes, meshes[index].mesh);
+            if (!meshes[index].instance) {
+                meshes[index].instance = render_instance_alloc(mesh) + 1;
             }
+            render_instance_mark_dirty(mesh, meshes[index].instance - 1);
+            changed[n_writes++] = index;
+        }
 
-            u8Slice slice = slice_u8_one(&entity->transform._matrix);
-            vektor_add_arr(mesh->instance_data, slice);
-            mesh->n_instances++;
+        RenderInstanceWrites writes = {
+            .indices = changed,
+            .transforms = transforms,
+            .meshes = meshes,
+            .planets = planets,
+        };
+        if (n_writes > RENDER_INSTANCE_BATCH) {
+            JobCounter counter = { 0 };
+            jobs_parallel_for(&counter, "render_instance_write_job", n_writes, RENDER_INSTANCE_BATCH, render_instance_write_job, &writes);
+            job_wait(&counter);
+        }
+        else {
+            render_instance_write_job(&writes, 0, n_writes);
         }
+        vektor_clear(scene->instances.changed);
+        scene->instances.n_changed = 0;
     }
 
-    {
-        MeshIter mesh_iter = { 0 };
-        while (genarr_next_valid(renderer.meshes, &mesh_iter)) {
-            u8Slice slice = slice_vektor(mesh_iter.mesh->instance_data);
-            reni_buffer_write(renderer.reni, mesh_iter.mesh->instance_buffer, slice, 0);
-        }
+    render_cull_horizon(scene);
+
+    PROFILE_END();
+}
+
+static i32 render_compare_u32(const void* a, const void* b) {
+    u32 x = *(const u32*)a;
+    u32 y = *(const u32*)b;
+    return (x > y) - (x < y);
+}
+
+// one buffer write per run of consecutive slots, dirty has to be sorted
+static void render_upload_runs(ReniBuffer buffer, const u8* data, usize stride, const u32* dirty, u32 n_dirty) {
+    u32 run_start = 0;
+    for (u32 i = 1; i <= n_dirty; i++) {
+        if (i < n_dirty && dirty[i] == dirty[i - 1] + 1) continue;
+
+        usize offset = dirty[run_start] * stride;
+        usize size = (dirty[i - 1] - dirty[run_start] + 1) * stride;
+        render_buffer_write(buffer, slice_to((u8*)data + offset, size), offset);
+        run_start = i;
     }
+}
 
-    ReniRenderpass pass = reni_create_renderpass(renderer.reni, (ReniRenderpassConfig) {
-        .targets[0] = {
-            .texture = surface_texture,
-            .clear = true,
-            .clear_value = { 84.0f / 255.0f, 119.0f / 255.0f, 146.0f / 255.0f, 1.0f },
-        },
-        .depth = {
-            .target = renderer.depth.texture,
-            .clear = true,
-            .clear_value = 1.0f,
+static void render_upload_mesh(Mesh* mesh) {
+    u32* dirty = slice_vektor(mesh->dirty_slots).start;
+    bool full = mesh->n_slots_allocated != mesh->n_slots_uploaded;
+
+    if (full) {
+        render_buffer_write(mesh->instance_buffer, slice_vektor(mesh->instance_data), 0);
+        mesh->n_slots_uploaded = mesh->n_slots_allocated;
+    }
+    else if (mesh->n_dirty) {
+        qsort(dirty, mesh->n_dirty, sizeof(u32), render_compare_u32);
+        render_upload_runs(mesh->instance_buffer, slice_vektor(mesh->instance_data).start, mesh->slot_size, dirty, mesh->n_dirty);
+    }
+
+    u8* slot_dirty = slice_vektor(mesh->slot_dirty).start;
+    for (u32 i = 0; i < mesh->n_dirty; i++) {
+        slot_dirty[dirty[i]] = 0;
+    }
+    vektor_clear(mesh->dirty_slots);
+    mesh->n_dirty = 0;
+}
+
+// writes dirty slots as runs of consecutive slots, one buffer write per run
+void render_upload_instances(void) {
+    PROFILE_BEGIN("render_upload_instances");
+
+    MeshIter mesh_iter = { 0 };
+    while (genarr_next_valid(renderer.meshes, &mesh_iter)) {
+        render_upload_mesh(mesh_iter.mesh);
+    }
+
+    PROFILE_END();
+}
+
+// a shared mesh draws its owner's whole visible list when its own bound is in
+// view under any of the owner's slots. the owner's bound covers it, so the
+// owner's list already holds every slot that passes
+static void render_cull_shared(Mesh* mesh, Frustum* frustum, RenderCullStats* stats) {
+    mesh->n_instances = 0;
+    if (mesh->hidden) return;
+
+    Mesh* owner = genarr_get(renderer.meshes, mesh->instances);
+    stats->n_tested++;
+    if (!owner->n_instances) return;
+
+    vec3s center = { .x = mesh->bound.x, .y = mesh->bound.y, .z = mesh->bound.z };
+    f32 pad = mesh->planet ? PLANET_SHELL_HEIGHT * (vec3_norm(center) + mesh->bound.w) : 0.0f;
+    u32* slots = mrw_alloc_n(memory.frame, u32, max(owner->n_slots, 1u));
+    if (!cull_instances(frustum, slice_vektor(owner->instance_data).start, owner->slot_size, owner->n_slots, mesh->bound, pad, slots)) return;
+
+    mesh->n_instances = owner->n_instances;
+    stats->n_visible++;
+}
+
+// tests every slot's bounding sphere against the camera frustum and writes
+// each mesh's visible list. for planets the list also carries where each one's
+// shells start, so n_instances is the sum of shells over what's visible.
+// slots render_cull_horizon hid are dropped after the frustum test.
+// shared meshes come after their owners, see render_cull_shared
+void render_cull_instances(void) {
+    PROFILE_BEGIN("render_cull_instances");
+
+    Frustum frustum = frustum_from_matrix(renderer.shader_data.data.camera_matrix);
+    RenderCullStats stats = renderer.cull.stats;
+    stats.n_tested = stats.n_visible = 0;
+    u32 n_planet_instances = 0;
+
+    MeshIter mesh_iter = { 0 };
+    while (genarr_next_valid(renderer.meshes, &mesh_iter)) {
+        Mesh* mesh = mesh_iter.mesh;
+        if (mesh->shared) continue;
+        const u8* data = slice_vektor(mesh->instance_data).start;
+        stats.n_tested += mesh->n_slots - mesh->n_free;
+
+        // the outer shell adds PLANET_SHELL_HEIGHT to the diagonal of the
+        // planet's matrix in planet.wgsl, in world units whatever its scale.
+        // that moves a vertex v by at most PLANET_SHELL_HEIGHT * |v| and no
+        // vertex is farther than |center| + radius from the mesh origin
+        vec3s center = { .x = mesh->bound.x, .y = mesh->bound.y, .z = mesh->bound.z };
+        f32 pad = mesh->planet ? PLANET_SHELL_HEIGHT * (vec3_norm(center) + mesh->bound.w) : 0.0f;
+
+        u32* slots = mrw_alloc_n(memory.frame, u32, max(mesh->n_slots, 1u));
+        u32 n_visible = cull_instances(&frustum, data, mesh->slot_size, mesh->n_slots, mesh->bound, pad, slots);
+
+        const u8* hidden = slice_vektor(mesh->slot_hidden).start;
+        u32 n_shown = 0;
+        for (u32 i = 0; i < n_visible; i++) {
+            if (!hidden[slots[i]]) slots[n_shown++] = slots[i];
         }
-    });
+        n_visible = n_shown;
+        stats.n_visible += n_visible;
+        mesh->n_visible = n_visible;
 
-    MeshIter iter = { 0 };
-    while (genarr_next_valid(renderer.meshes, &iter)) {
-        Mesh* mesh = iter.mesh;
-        reni_renderpass_set_shader(renderer.reni, pass, iter.mesh->shader == 0 ? renderer.plants.shader : renderer.planets.shader);
-        reni_renderpass_set_binding(renderer.reni, pass, 0, renderer.shader_data.binding);
-        reni_renderpass_draw(renderer.reni, pass, (ReniDrawConfig) {
-           .vertices = mesh->vertex_buffer,
-           .indices = mesh->index_buffer,
-           .instances = mesh->instance_buffer,
-           .n_instances = mesh->n_instances
-        });
+        usize size = sizeof(RenderVisibleList) + n_visible * sizeof(RenderVisibleInstance);
+        RenderVisibleList* list = (RenderVisibleList*)mrw_alloc_n(memory.frame, u32, size / sizeof(u32));
+        list->count = n_visible;
+
+        u32 n_shells = 0;
+        for (u32 i = 0; i < n_visible; i++) {
+            list->entries[i] = (RenderVisibleInstance){ .slot = slots[i], .first_shell = n_shells };
+            if (mesh->planet) {
+                n_shells += ((const PlanetInstance*)(data + slots[i] * mesh->slot_size))->n_shells;
+            }
+        }
+
+        mesh->n_instances = mesh->planet ? n_shells : n_visible;
+        if (mesh->planet) n_planet_instances += n_shells;
+        if (mesh->n_instances) {
+            render_buffer_write(mesh->visible_buffer, slice_to((u8*)list, size), 0);
+        }
+    }
+
+    mesh_iter = (MeshIter){ 0 };
+    while (genarr_next_valid(renderer.meshes, &mesh_iter)) {
+        if (mesh_iter.mesh->shared) render_cull_shared(mesh_iter.mesh, &frustum, &stats);
     }
 
-    reni_submit_renderpass(renderer.reni, pass);
+    renderer.cull.stats = stats;
+    PROFILE_COUNTER("instances tested", 0, stats.n_tested);
+    PROFILE_COUNTER("instances visible", 0, stats.n_visible);
+    PROFILE_COUNTER("instances culled", 0, stats.n_tested - stats.n_visible);
+    PROFILE_COUNTER("planet instances", 0, n_planet_instances);
+
+    PROFILE_END();
 }
 
-void render_render_atmosphere(Scene* scene, ReniTexture surface_texture) {
+void render_build_atmosphere(Scene* scene) {
+    PROFILE_BEGIN("render_build_atmosphere");
+
     u32 n_planets = 0;
 
     {
-        EntityIter planet_iter = { .include = CT_Planet | CT_Mesh };
+        EntityIter planet_iter = { .include = CT_Planet | CT_Transform };
         while (scene_next_entity(scene, &planet_iter)) {
             n_planets++;
         }
@@ -421,27 +935,191 @@ void render_render_atmosphere(Scene* scene, ReniTexture surface_texture) {
 
     AtmospherePlanet buffer[n_planets];
     u32 i = 0;
-    EntityIter iter = { .include = CT_Planet | CT_Mesh };
+    EntityIter iter = { .include = CT_Planet | CT_Transform };
     while (scene_next_entity(scene, &iter)) {
-        buffer[i].pos = iter.entity->transform.world.pos;
-        buffer[i].radius = iter.entity->transform.world.scale;
+        struct Transform* world = &scene_column(scene, transform)[iter.index].world;
+        buffer[i].pos = world->pos;
+        buffer[i].radius = world->scale;
         i++;
     }
-    reni_buffer_write(renderer.reni, renderer.atmosphere.buffer, slice_u8_arr(buffer), 0);
+    render_buffer_write(renderer.atmosphere.buffer, slice_u8_arr(buffer), 0);
+
+    PROFILE_END();
+}
+
+// a packet per mesh with anything to draw, binding 1 is the mesh's own
+// instances and visible list, or its owner's. meshes that only hold
+// instances for others have no indices
+void render_queue_meshes(void) {
+    RenderQueue* queue = &renderer.queue;
+
+    MeshIter iter = { 0 };
+    while (genarr_next_valid(renderer.meshes, &iter)) {
+        Mesh* mesh = iter.mesh;
+        if (!mesh->n_instances || !mesh->n_indices) continue;
+        render_queue_push(queue, render_queue_key(RP_Meshes, mesh->shader.index, mesh->binding_id, mesh->id), (RenderPacket){
+            .shader = mesh->shader,
+            .binding = mesh->binding,
+            .binding_id = mesh->binding_id,
+            .n_vertices = mesh->n_indices,
+            .draw = {
+               .vertices = mesh->vertex_buffer,
+               .indices = mesh->index_buffer,
+               .n_instances = mesh->n_instances
+            }
+        });
+    }
+}
+
+void render_queue_atmosphere(void) {
+    render_queue_push(&renderer.queue, render_queue_key(RP_Atmosphere, renderer.atmosphere.shader.index, renderer.atmosphere.id, 0), (RenderPacket){
+        .shader = renderer.atmosphere.shader,
+        .binding = renderer.atmosphere.binding,
+        .binding_id = renderer.atmosphere.id,
+        .n_vertices = 6,
+        .draw = { .n_vertices = 6, .n_instances = 1 }
+    });
+}
+
+void render_build_queue(void) {
+    PROFILE_BEGIN("render_build_queue");
+
+    render_queue_begin(&renderer.queue);
+    render_queue_meshes();
+    render_queue_atmosphere();
+    render_queue_sort(&renderer.queue);
+
+    PROFILE_END();
+}
+
+// everything a frame draws, up to the sorted queue
+void render_build_frame(Scene* scene) {
+    render_gather_instances(scene);
+    render_upload_instances();
+    render_cull_instances();
+    render_build_atmosphere(scene);
+    render_build_queue();
+}
+
+#ifdef FLOS_HEADLESS
 
-    ReniRenderpass pass = reni_create_renderpass(renderer.reni, (ReniRenderpassConfig){ .targets[0].texture = surface_texture });
+static void render_set_shader(ShaderHandle shader) {
+    render_null_record((RenderNullCommand){ .type = RNC_SetShader, .shader = shader.index });
+}
+
+static void render_set_binding(RenderPacket* packet) {
+    render_null_record((RenderNullCommand){ .type = RNC_SetBinding, .binding = packet->binding_id });
+}
+
+static void render_draw(RenderPacket* packet) {
+    render_null_record((RenderNullCommand){
+        .type = RNC_Draw,
+        .shader = packet->shader.index,
+        .n_vertices = packet->n_vertices,
+        .n_instances = packet->draw.n_instances,
+    });
+}
+
+#else // FLOS_HEADLESS
+
+// the renderpass render_submit_queue is recording into
+static ReniRenderpass render_pass = { 0 };
+
+static void render_set_shader(ShaderHandle shader) {
+    reni_renderpass_set_shader(renderer.reni, render_pass, shaders_get(shader));
+}
+
+static void render_set_binding(RenderPacket* packet) {
+    reni_renderpass_set_binding(renderer.reni, render_pass, 1, packet->binding);
+}
+
+static void render_draw(RenderPacket* packet) {
+    reni_renderpass_draw(renderer.reni, render_pass, packet->draw);
+}
 
-    reni_renderpass_set_shader(renderer.reni, pass, renderer.atmosphere.shader);
+#endif // FLOS_HEADLESS
+
+// the pass's packets in key order, the shader and binding 1 are only set when
+// they differ from the packet before
+static void render_submit_queue(RenderPassId pass) {
+    RenderQueue* queue = &renderer.queue;
+    RenderPacket* last = nullptr;
+    for (u32 i = 0; i < queue->n_packets; i++) {
+        RenderQueueEntry entry = queue->sorted[i];
+        if (render_queue_key_pass(entry.key) != pass) continue;
+
+        RenderPacket* packet = render_queue_packet(queue, entry);
+        if (!last || last->shader.index != packet->shader.index) {
+            render_set_shader(packet->shader);
+            queue->stats.n_shader_switches++;
+        }
+        if (!last || last->binding_id != packet->binding_id) {
+            render_set_binding(packet);
+            queue->stats.n_binding_switches++;
+        }
+        render_draw(packet);
+        last = packet;
+    }
+}
+
+#ifdef FLOS_HEADLESS
+
+void render_render_meshes(void) {
+    render_submit_queue(RP_Meshes);
+}
+
+void render_render_atmosphere(void) {
+    render_submit_queue(RP_Atmosphere);
+}
+
+#else // FLOS_HEADLESS
+
+// group 0 is the same in every shader, bound once per pass it stays bound
+// across shader changes
+static void render_begin_pass(ReniRenderpass pass) {
+    render_pass = pass;
     reni_renderpass_set_binding(renderer.reni, pass, 0, renderer.shader_data.binding);
-    reni_renderpass_set_binding(renderer.reni, pass, 1, renderer.atmosphere.binding);
-    reni_renderpass_draw(renderer.reni, pass, (ReniDrawConfig){ .n_vertices = 6, .n_instances = 1 });
+}
+
+void render_render_meshes(ReniTexture surface_texture) {
 
-    reni_submit_renderpass(renderer.reni, pass);
+    render_begin_pass(reni_create_renderpass(renderer.reni, (ReniRenderpassConfig) {
+        .targets[0] = {
+            .texture = surface_texture,
+            .clear = true,
+            .clear_value = { 84.0f / 255.0f, 119.0f / 255.0f, 146.0f / 255.0f, 1.0f },
+        },
+        .depth = {
+            .target = renderer.depth.texture,
+            .clear = true,
+            .clear_value = 1.0f,
+        }
+    }));
+    render_submit_queue(RP_Meshes);
+
+    PROFILE_ZONE("reni_submit_renderpass meshes") reni_submit_renderpass(renderer.reni, render_pass);
+}
+
+void render_render_atmosphere(ReniTexture surface_texture) {
+    render_begin_pass(reni_create_renderpass(renderer.reni, (ReniRenderpassConfig){ .targets[0].texture = surface_texture }));
+    render_submit_queue(RP_Atmosphere);
+
+    PROFILE_ZONE("reni_submit_renderpass atmosphere") reni_submit_renderpass(renderer.reni, render_pass);
+}
+
+#endif // FLOS_HEADLESS
+
+static void render_count_queue(void) {
+    RenderQueueStats* stats = &renderer.queue.stats;
+    PROFILE_COUNTER("render packets", 0, stats->n_packets);
+    PROFILE_COUNTER("shader switches", 0, stats->n_shader_switches);
+    PROFILE_COUNTER("binding switches", 0, stats->n_binding_switches);
 }
 
 f32 planet_grass_scale = 0.01;
 
 void render_prepare(Scene* scene) {
+#ifndef FLOS_HEADLESS
     if (window.width != renderer.width || window.height != renderer.height) {
         renderer.width = window.width;
         renderer.height = window.height;
@@ -452,36 +1130,55 @@ void render_prepare(Scene* scene) {
 
         reni_texture_resize(renderer.reni, renderer.depth.texture, renderer.width, renderer.height);
     }
+#endif // FLOS_HEADLESS
 
     // upload render data
     {
-        Entity* camera = scene_get_entity(scene, scene->camera);
-        mat4s proj = glms_perspective(to_rad(80.0f), (f32)renderer.width / (f32)renderer.height, 0.01f, 1000.0f);
-        mat4s world_mat = mat4_from_transform(&camera->transform.world);
+        struct TransformC* camera = entity_transform(scene, scene->camera);
+        mat4s proj = glms_perspective(to_rad(RENDER_FOV), (f32)renderer.width / (f32)renderer.height, 0.01f, 1000.0f);
+        mat4s world_mat = mat4_from_transform(&camera->world);
         mat4s view = mat4_inv(world_mat);
         mat4s vp = mat4_mul(proj, view);
         glm_mat4_copy(vp.raw, renderer.shader_data.data.camera_matrix);
         glm_mat4_copy(mat4_inv(vp).raw, renderer.shader_data.data.inv_camera_matrix);
-        renderer.shader_data.data.camera_position = camera->transform.world.pos;
+        renderer.shader_data.data.camera_position = camera->world.pos;
 
         renderer.shader_data.data.res.x = (f32)window.width;
         renderer.shader_data.data.res.y = (f32)window.height;
 
-        reni_buffer_write(renderer.reni, renderer.shader_data.buffer, slice_u8_one(&renderer.shader_data.data), 0);
+        render_buffer_write(renderer.shader_data.buffer, slice_u8_one(&renderer.shader_data.data), 0);
     }
 }
 
+#ifdef FLOS_HEADLESS
+
+void render_render(Scene* scene) {
+    render_null_begin_frame();
+    render_prepare(scene);
+    render_build_frame(scene);
+    render_render_meshes();
+    render_render_atmosphere();
+    render_count_queue();
+}
+
+#else // FLOS_HEADLESS
+
 void render_render(Scene* scene) {
+    shaders_poll(renderer.reni);
     render_prepare(scene);
 
-    reni_begin(renderer.reni);
+    PROFILE_ZONE("reni_begin") reni_begin(renderer.reni);
 
+    PROFILE_BEGIN("reni_surface_acquire");
     ReniSurfaceAcquired surface = reni_surface_acquire(renderer.reni, renderer.surface);
+    PROFILE_END();
     if (surface.status != ReniSurfaceStatus_SuccessOptimal)
         mrw_error("Surface acquire error {}", (u32)surface.status);
 
-    render_render_meshes(scene, surface.texture);
-    render_render_atmosphere(scene, surface.texture);
+    render_build_frame(scene);
+    render_render_meshes(surface.texture);
+    render_render_atmosphere(surface.texture);
+    render_count_queue();
 
     // ripple_submit(&renderer.ripple_context,
     //     renderer.width, renderer.height,
@@ -491,5 +1188,7 @@ void render_render(Scene* scene) {
     //     }
     // );
 
-    reni_end(renderer.reni);
+    PROFILE_ZONE("reni_end") reni_end(renderer.reni);
 }
+
+#endif // FLOS_HEADLESS
@@ -0,0 +1,62 @@
+#define FLOS_RENDER_NULL
+#include "base.c"
+
+// null backend for the headless build, render.c records what it would have
+// submitted here instead of talking to reni
+
+#ifdef FLOS_HEADLESS
+
+typedef enum {
+    RNC_BufferWrite,
+    RNC_Draw,
+    // state changes the render queue could not sort away, binding is group 1
+    RNC_SetShader,
+    RNC_SetBinding,
+} RenderNullCommandType;
+
+STRUCT(RenderNullCommand) {
+    RenderNullCommandType type;
+    u32 shader;
+    u32 binding;
+    u32 n_vertices;
+    u32 n_instances;
+    usize n_bytes;
+};
+
+STRUCT(RenderNullFrame) {
+    u32 n_draws;
+    u32 n_instances;
+    usize n_bytes_uploaded;
+};
+
+struct {
+    VEKTOR(RenderNullCommand) commands;
+    RenderNullFrame frame;
+} render_null = { 0 };
+
+void render_null_init(void) {
+    vektor_init(render_null.commands, 64, memory.stable);
+}
+
+void render_null_begin_frame(void) {
+    vektor_clear(render_null.commands);
+    render_null.frame = (RenderNullFrame){ 0 };
+}
+
+void render_null_record(RenderNullCommand command) {
+    vektor_add(render_null.commands, command);
+    switch (command.type) {
+        case RNC_BufferWrite:
+            render_null.frame.n_bytes_uploaded += command.n_bytes;
+            break;
+        case RNC_Draw:
+            render_null.frame.n_draws++;
+            render_null.frame.n_instances += command.n_instances;
+            break;
+        case RNC_SetShader:
+        case RNC_SetBinding:
+            break;
+    }
+}
+
+#endif // FLOS_HEADLESS
@@ -0,0 +1,109 @@
+#define FLOS_RENDER_QUEUE
+#include "base.c"
+
+// draws are collected for the whole frame as packets, sorted by a 64 bit key
+// and submitted a pass at a time. sorting puts packets sharing a shader and
+// then a binding next to each other, so submitting only has to set what
+// changed from the packet before
+//
+//     key = pass:4 | shader:12 | binding:16 | mesh:32
+
+STRUCT(RenderPacket) {
+    ShaderHandle shader;
+    // group 1, binding_id is what submit compares
+    ReniBinding binding;
+    u32 binding_id;
+    // index count for the null backend
+    u32 n_vertices;
+    ReniDrawConfig draw;
+};
+
+STRUCT(RenderQueueStats) {
+    u32 n_packets;
+    u32 n_shader_switches;
+    u32 n_binding_switches;
+};
+
+STRUCT(RenderQueueEntry) {
+    u64 key;
+    u32 packet;
+};
+
+STRUCT(RenderQueue) {
+    VEKTOR(RenderPacket) packets;
+    VEKTOR(RenderQueueEntry) entries;
+    u32 n_packets;
+    // entries in key order once sorted, from the frame allocator
+    RenderQueueEntry* sorted;
+    RenderQueueStats stats;
+};
+
+void render_queue_init(RenderQueue* queue) {
+    vektor_init(queue->packets, 16, memory.stable);
+    vektor_init(queue->entries, 16, memory.stable);
+}
+
+void render_queue_begin(RenderQueue* queue) {
+    vektor_clear(queue->packets);
+    vektor_clear(queue->entries);
+    queue->n_packets = 0;
+    queue->sorted = nullptr;
+    queue->stats = (RenderQueueStats){ 0 };
+}
+
+u64 render_queue_key(u32 pass, u32 shader, u32 binding, u32 mesh) {
+    return (u64)(pass & 0xF) << 60 | (u64)(shader & 0xFFF) << 48 | (u64)(binding & 0xFFFF) << 32 | mesh;
+}
+
+u32 render_queue_key_pass(u64 key) {
+    return (u32)(key >> 60);
+}
+
+void render_queue_push(RenderQueue* queue, u64 key, RenderPacket packet) {
+    vektor_add(queue->packets, packet);
+    vektor_add(queue->entries, ((RenderQueueEntry){ .key = key, .packet = queue->n_packets }));
+    queue->n_packets++;
+    queue->stats.n_packets++;
+}
+
+// lsd radix sort, a byte at a time. bytes every key agrees on are skipped,
+// with a few passes and shaders that's most of them. stable, so packets with
+// equal keys keep the order they were pushed in
+void render_queue_sort(RenderQueue* queue) {
+    PROFILE_BEGIN("render_queue_sort");
+
+    u32 n = queue->n_packets;
+    RenderQueueEntry* from = mrw_alloc_n(memory.frame, RenderQueueEntry, max(n, 1u));
+    RenderQueueEntry* to = mrw_alloc_n(memory.frame, RenderQueueEntry, max(n, 1u));
+    buf_copy(from, slice_vektor(queue->entries).start, n * sizeof(RenderQueueEntry));
+
+    for (u32 shift = 0; shift < 64 && n; shift += 8) {
+        u32 counts[256] = { 0 };
+        for (u32 i = 0; i < n; i++) {
+            counts[(from[i].key >> shift) & 0xFF]++;
+        }
+        if (counts[(from[0].key >> shift) & 0xFF] == n) continue;
+
+        u32 offset = 0;
+        for (u32 b = 0; b < 256; b++) {
+            u32 count = counts[b];
+            counts[b] = offset;
+            offset += count;
+        }
+        for (u32 i = 0; i < n; i++) {
+            to[counts[(from[i].key >> shift) & 0xFF]++] = from[i];
+        }
+
+        RenderQueueEntry* swap = from;
+        from = to;
+        to = swap;
+    }
+
+    queue->sorted = from;
+
+    PROFILE_END();
+}
+
+RenderPacket* render_queue_packet(RenderQueue* queue, RenderQueueEntry entry) {
+    return &slice_vektor(queue->packets).start[entry.packet];
+}
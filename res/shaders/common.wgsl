@@ -10,6 +10,22 @@ struct ShaderData {
     atmosphere_falloff: f32,
 };
 
+struct Instance {
+    model: mat4x4f,
+};
+
+// written by render_cull_instances, one entry per visible slot.
+// first_shell is only used by planets
+struct VisibleInstance {
+    slot: u32,
+    first_shell: u32,
+};
+
+struct VisibleList {
+    count: u32,
+    entries: array<VisibleInstance>,
+};
+
 const PI = 3.14159265359;
 
 const FULLSCREEN_QUAD_POSITIONS : array<vec2f, 6> = array<vec2f, 6>(
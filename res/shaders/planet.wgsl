@@ -5,15 +5,18 @@ struct VertexInput {
     @location(1) normal: vec3f,
 };
 
-struct InstanceInput {
-    @location(3) m0: vec4f,
-    @location(4) m1: vec4f,
-    @location(5) m2: vec4f,
-    @location(6) m3: vec4f,
-    @location(7) shell_t: f32,
-    @location(8) scale: f32,
+struct PlanetInstance {
+    model: mat4x4f,
+    scale: f32,
+    n_shells: u32,
+    _pad0: f32,
+    _pad1: f32,
 };
 
+// one entry per planet, every shell of every visible planet is its own instance
+@group(1) @binding(0) var<storage, read> planets: array<PlanetInstance>;
+@group(1) @binding(1) var<storage, read> visible: VisibleList;
+
 struct VertexOutput{
     @builtin(position) position: vec4f,
     @location(0) normal: vec3f,
@@ -22,19 +25,40 @@ struct VertexOutput{
     @location(3) scale: f32,
 };
 
+// first_shell is a running sum over the visible list, so the planet an
+// instance belongs to is the last one starting at or before it. planets
+// without shells start where the next one does and are never picked
+fn find_visible(instance: u32) -> u32 {
+    var lo = 0u;
+    var hi = visible.count;
+    while (lo + 1u < hi) {
+        let mid = (lo + hi) / 2u;
+        if (visible.entries[mid].first_shell <= instance) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
 @vertex
-fn vs_main(v: VertexInput, i: InstanceInput) -> VertexOutput {
-    var model = mat4x4f(i.m0, i.m1, i.m2, i.m3);
-    model[0][0] += i.shell_t * 0.05f;
-    model[1][1] += i.shell_t * 0.05f;
-    model[2][2] += i.shell_t * 0.05f;
+fn vs_main(v: VertexInput, @builtin(instance_index) instance: u32) -> VertexOutput {
+    let entry = visible.entries[find_visible(instance)];
+    let planet = planets[entry.slot];
+    let shell_t = f32(instance - entry.first_shell) / f32(max(planet.n_shells, 2u) - 1u);
+
+    var model = planet.model;
+    model[0][0] += shell_t * 0.05f;
+    model[1][1] += shell_t * 0.05f;
+    model[2][2] += shell_t * 0.05f;
     let world = model * vec4f(v.position.xyz, 1.0f);
     var out: VertexOutput;
     out.position = shader_data.camera_matrix * world;
     out.normal = v.normal;
-    out.shell_t = f32(i.shell_t);
+    out.shell_t = shell_t;
     out.world = world.xyz;
-    out.scale = i.scale;
+    out.scale = planet.scale;
     return out;
 }
 
@@ -5,24 +5,22 @@ struct VertexInput {
     @location(1) normal: vec3f,
 };
 
-struct InstanceInput {
-    @location(3) m0: vec4f,
-    @location(4) m1: vec4f,
-    @location(5) m2: vec4f,
-    @location(6) m3: vec4f,
-};
+@group(1) @binding(0) var<storage, read> instances: array<Instance>;
+@group(1) @binding(1) var<storage, read> visible: VisibleList;
 
 struct VertexOutput{
     @builtin(position) position: vec4f,
     @location(0) t: f32,
+    @location(1) normal: vec3f,
 };
 
 @vertex
-fn vs_main(v: VertexInput, i: InstanceInput) -> VertexOutput {
-    let model = mat4x4f(i.m0, i.m1, i.m2, i.m3);
+fn vs_main(v: VertexInput, @builtin(instance_index) instance: u32) -> VertexOutput {
+    let model = instances[visible.entries[instance].slot].model;
     var out: VertexOutput;
     out.position = shader_data.camera_matrix * model * vec4f(v.position.xyz, 1.0f);
     out.t = v.position.y / 2.0f;
+    out.normal = normalize((model * vec4f(v.normal, 0.0f)).xyz);
     return out;
 }
 
@@ -31,7 +29,8 @@ fn fs_main(in: VertexOutput) -> @location(0) vec4f {
     let dark = vec3f(27, 94, 32) / 255.0;
     let light = vec3f(1.0f);
 
-    let color = mix(dark, light, min(in.t * in.t, 1.0f));
+    let d = dot(normalize(in.normal), normalize(vec3f(1.0f, 1.0f, 1.0f))) * 0.5f + 0.5f;
+    let color = mix(dark, light, min(in.t * in.t, 1.0f)) * d;
 
     return vec4f(pow(color, vec3f(2.2)), 1.0f);
 }
@@ -3,98 +3,638 @@
 #define FLOS_SCENE
 #include "base.c"
 
+#define SCENE_NO_SLOT 0xFFFFFFFFu
+#define SCENE_MAX_DEPTH 64
+
+typedef enum {
+    // queued for scene_update_transforms, world of the subtree and matrix are stale
+    TF_Dirty = BIT(0),
+    // redone during the current scene_update_transforms, children follow
+    TF_Updated = BIT(1),
+    // already in scene->instances.changed
+    TF_InstanceQueued = BIT(2),
+} TransformFlags;
+
+// an instance slot that stopped being drawn, the renderer zeroes and reuses it
+STRUCT(SceneInstanceRelease) {
+    MeshHandle mesh;
+    u32 slot;
+};
+
+typedef enum {
+    SQM_None,
+    SQM_Member,
+    // still in the list but no longer matching, skipped until the next compact
+    SQM_Stale,
+} SceneQueryMembership;
+
+// matching entity slots for one include/any/exclude combination, kept up to
+// date as components change so iterating it only visits what matches
+STRUCT(SceneQuery) {
+    ComponentType include;
+    ComponentType any;
+    ComponentType exclude;
+
+    VEKTOR(u32) entities;
+    u32 n_entities;
+    u32 n_stale;
+
+    // per slot SceneQueryMembership
+    VEKTOR(u8) membership;
+};
+
+// entities are stored as columns indexed by slot, so a loop only pulls in the
+// components it actually reads. the components mask is its own column and is
+// all scene_next_entity touches while filtering
 STRUCT(Scene) {
-    GENARR(Entity) entities;
+    struct {
+        u32 n_slots;
+        u32 first_free;
+
+        // odd while the slot is alive, bumped on create and destroy
+        VEKTOR(u32) generation;
+        VEKTOR(ComponentType) components;
+        VEKTOR(str) name;
+        VEKTOR(struct EntityLinks) links;
+
+        VEKTOR(struct TransformC) transform;
+        VEKTOR(u8) transform_flags;
+        VEKTOR(u16) depth;
+        VEKTOR(u32) hierarchy_position;
+        VEKTOR(struct MeshC) mesh;
+        VEKTOR(struct PhysicsC) physics;
+        VEKTOR(struct PlanetC) planet;
+        VEKTOR(struct CameraC) camera;
+    } entities;
+
+    VEKTOR(SceneQuery) queries;
+    u32 n_queries;
+
+    struct {
+        u32 n_dirty;
+    } transforms;
+
+    // entities whose instance data has to be rewritten and slots that have to
+    // be given back, drained by render_gather_instances every frame
+    struct {
+        VEKTOR(u32) changed;
+        u32 n_changed;
+        VEKTOR(SceneInstanceRelease) released;
+        u32 n_released;
+    } instances;
+
+    // every live entity slot ordered by depth, so parents always come before
+    // their children. level_end[d] is one past the last entry at depth d
+    struct {
+        VEKTOR(u32) order;
+        u32 n;
+        u32 n_allocated;
+        u32 level_end[SCENE_MAX_DEPTH];
+    } hierarchy;
+
+    Allocator* allocator;
+
     EntityHandle player;
     EntityHandle camera;
     EntityHandle planets[2];
 };
 
-Entity* scene_get_entity(Scene* scene, EntityHandle handle) {
-    return genarr_get((scene)->entities, handle);
+#define scene_column(scene, column) (slice_vektor((scene)->entities.column).start)
+
+void scene_init(Scene* scene, u32 capacity, Allocator* allocator) {
+    *scene = (Scene){ .allocator = allocator };
+    scene->entities.first_free = SCENE_NO_SLOT;
+    vektor_init(scene->queries, 8, allocator);
+    vektor_init(scene->hierarchy.order, capacity, allocator);
+    vektor_init(scene->instances.changed, capacity, allocator);
+    vektor_init(scene->instances.released, 8, allocator);
+    vektor_init(scene->entities.generation, capacity, allocator);
+    vektor_init(scene->entities.components, capacity, allocator);
+    vektor_init(scene->entities.name, capacity, allocator);
+    vektor_init(scene->entities.links, capacity, allocator);
+    vektor_init(scene->entities.transform, capacity, allocator);
+    vektor_init(scene->entities.transform_flags, capacity, allocator);
+    vektor_init(scene->entities.depth, capacity, allocator);
+    vektor_init(scene->entities.hierarchy_position, capacity, allocator);
+    vektor_init(scene->entities.mesh, capacity, allocator);
+    vektor_init(scene->entities.physics, capacity, allocator);
+    vektor_init(scene->entities.planet, capacity, allocator);
+    vektor_init(scene->entities.camera, capacity, allocator);
+}
+
+bool scene_entity_valid(Scene* scene, EntityHandle handle) {
+    return handle.valid &&
+        handle.index < scene->entities.n_slots &&
+        scene_column(scene, generation)[handle.index] == handle.generation;
+}
+
+EntityHandle scene_entity_handle(Scene* scene, u32 index) {
+    return (EntityHandle){ .index = index, .generation = scene_column(scene, generation)[index], .valid = true };
+}
+
+#define SCENE_GETTER(T, column)\
+    T* entity_##column(Scene* scene, EntityHandle handle) {\
+        return scene_entity_valid(scene, handle) ? &scene_column(scene, column)[handle.index] : nullptr;\
+    }
+
+SCENE_GETTER(struct EntityLinks, links)
+SCENE_GETTER(struct TransformC, transform)
+SCENE_GETTER(struct MeshC, mesh)
+SCENE_GETTER(struct PhysicsC, physics)
+SCENE_GETTER(struct PlanetC, planet)
+SCENE_GETTER(struct CameraC, camera)
+
+#undef SCENE_GETTER
+
+static bool scene_query_matches(SceneQuery* query, ComponentType comps) {
+    if (!comps) return false;
+    if (FLAG_HAS_ANY(comps, query->exclude)) return false;
+    if (query->any && FLAG_HAS_ANY(comps, query->any)) return true;
+    return FLAG_HAS_ALL(comps, query->include);
 }
 
-#define for_each_entity_children(e, val)\
-    for (Entity* val = scene_get_entity((e)->scene, (e)->first_child); val; val = scene_get_entity((e)->scene, val->next_sibling))
+static void scene_query_add(SceneQuery* query, u32 index) {
+    u8* membership = slice_vektor(query->membership).start;
+    if (membership[index] == SQM_Stale) {
+        query->n_stale--;
+    }
+    else if (membership[index] == SQM_None) {
+        vektor_add(query->entities, index);
+        query->n_entities++;
+    }
+    membership[index] = SQM_Member;
+}
+
+static void scene_query_remove(SceneQuery* query, u32 index) {
+    u8* membership = slice_vektor(query->membership).start;
+    if (membership[index] != SQM_Member) return;
+    membership[index] = SQM_Stale;
+    query->n_stale++;
+}
+
+// drops stale entries. iterators index into the list, so this only runs from
+// scene_end_frame when none can be walking it
+static void scene_query_compact(SceneQuery* query) {
+    u8* membership = slice_vektor(query->membership).start;
+    u32* entities = slice_vektor(query->entities).start;
+
+    u32 n = 0;
+    for (u32 i = 0; i < query->n_entities; i++) {
+        u32 index = entities[i];
+        if (membership[index] == SQM_Member) {
+            entities[n++] = index;
+        }
+        else {
+            membership[index] = SQM_None;
+        }
+    }
+
+    vektor_clear(query->entities);
+    for (u32 i = 0; i < n; i++) {
+        vektor_add(query->entities, entities[i]);
+    }
+    query->n_entities = n;
+    query->n_stale = 0;
+}
+
+// keeps every cached query in sync with a slot's components changing from prev to next
+static void scene_queries_update(Scene* scene, u32 index, ComponentType prev, ComponentType next) {
+    SceneQuery* queries = slice_vektor(scene->queries).start;
+    for (u32 q = 0; q < scene->n_queries; q++) {
+        SceneQuery* query = &queries[q];
+        bool was = scene_query_matches(query, prev);
+        bool is = scene_query_matches(query, next);
+        if (was == is) continue;
+        if (is) scene_query_add(query, index);
+        else scene_query_remove(query, index);
+    }
+}
+
+static SceneQuery* scene_get_query(Scene* scene, ComponentType include, ComponentType any, ComponentType exclude) {
+    SceneQuery* queries = slice_vektor(scene->queries).start;
+    for (u32 q = 0; q < scene->n_queries; q++) {
+        SceneQuery* query = &queries[q];
+        if (query->include == include && query->any == any && query->exclude == exclude) {
+            return query;
+        }
+    }
+
+    SceneQuery query = { .include = include, .any = any, .exclude = exclude };
+    vektor_init(query.entities, 16, scene->allocator);
+    vektor_init(query.membership, max(scene->entities.n_slots, 1u), scene->allocator);
+
+    ComponentType* components = scene_column(scene, components);
+    for (u32 i = 0; i < scene->entities.n_slots; i++) {
+        bool matches = scene_query_matches(&query, components[i]);
+        vektor_add(query.membership, (u8)(matches ? SQM_Member : SQM_None));
+        if (matches) {
+            vektor_add(query.entities, i);
+            query.n_entities++;
+        }
+    }
+
+    vektor_add(scene->queries, query);
+    scene->n_queries++;
+    return &slice_vektor(scene->queries).start[scene->n_queries - 1];
+}
+
+static bool scene_instance_visible(ComponentType comps) {
+    return FLAG_HAS_ALL(comps, CT_Mesh | CT_Transform) && !FLAG_HAS_ANY(comps, CT_IsHidden);
+}
+
+static void scene_instance_queue(Scene* scene, u32 index) {
+    u8* flags = &scene_column(scene, transform_flags)[index];
+    if (FLAG_HAS_ALL(*flags, TF_InstanceQueued)) return;
+    FLAG_SET(*flags, TF_InstanceQueued);
+    vektor_add(scene->instances.changed, index);
+    scene->instances.n_changed++;
+}
+
+static void scene_instance_release(Scene* scene, u32 index) {
+    struct MeshC* mesh = &scene_column(scene, mesh)[index];
+    if (!mesh->instance) return;
+    vektor_add(scene->instances.released, ((SceneInstanceRelease){ .mesh = mesh->mesh, .slot = mesh->instance - 1 }));
+    scene->instances.n_released++;
+    mesh->instance = 0;
+}
+
+static void scene_set_components(Scene* scene, u32 index, ComponentType components) {
+    ComponentType* column = scene_column(scene, components);
+    ComponentType prev = column[index];
+    column[index] = components;
+    if (prev != components) {
+        scene_queries_update(scene, index, prev, components);
+
+        bool was_visible = scene_instance_visible(prev);
+        bool is_visible = scene_instance_visible(components);
+        if (was_visible && !is_visible) scene_instance_release(scene, index);
+        if (!was_visible && is_visible) scene_instance_queue(scene, index);
+    }
+}
+
+// for when something the instance data is built from changed besides the transform
+void entity_instance_changed(Scene* scene, EntityHandle handle) {
+    if (scene_instance_visible(scene_column(scene, components)[handle.index])) {
+        scene_instance_queue(scene, handle.index);
+    }
+}
+
+void entity_set_mesh(Scene* scene, EntityHandle handle, MeshHandle mesh) {
+    scene_instance_release(scene, handle.index);
+    scene_column(scene, mesh)[handle.index].mesh = mesh;
+    entity_instance_changed(scene, handle);
+}
+
+void entity_enable_components(Scene* scene, EntityHandle handle, ComponentType components) {
+    ComponentType comps = scene_column(scene, components)[handle.index];
+    FLAG_SET(comps, components);
+    scene_set_components(scene, handle.index, comps);
+}
+
+void entity_disable_components(Scene* scene, EntityHandle handle, ComponentType components) {
+    ComponentType comps = scene_column(scene, components)[handle.index];
+    FLAG_CLEAR(comps, components);
+    scene_set_components(scene, handle.index, comps);
+}
+
+bool entity_has(Scene* scene, EntityHandle handle, ComponentType components) {
+    return scene_entity_valid(scene, handle) && FLAG_HAS_ALL(scene_column(scene, components)[handle.index], components);
+}
+
+#define for_each_entity_children(scene, e, val)\
+    for (EntityHandle val = entity_links((scene), (e))->first_child; val.valid; val = entity_links((scene), val)->next_sibling)
 
 typedef enum {
     ETU_LOCAL,
     ETU_WORLD,
 } EntityTransformUpdate;
 
-struct Transform transform_calculate_world(struct Transform parent, struct Transform local) {
-    return (struct Transform){
-      .pos = vec3_add(parent.pos, quat_rotatev(parent.rot, vec3_scale(local.pos, parent.scale))),
-      .rot = quat_mul(parent.rot, local.rot),
-      .scale = parent.scale * local.scale,
-    };
+static void entity_transform_mark_dirty(Scene* scene, u32 index) {
+    u8* flags = &scene_column(scene, transform_flags)[index];
+    if (FLAG_HAS_ALL(*flags, TF_Dirty)) return;
+    FLAG_SET(*flags, TF_Dirty);
+    scene->transforms.n_dirty++;
 }
 
-struct Transform transform_calculate_local(struct Transform parent, struct Transform world) {
-    quats parent_inv_rot = quat_inv(parent.rot);
-    return (struct Transform){
-      .pos = vec3_scale(quat_rotatev(parent_inv_rot, vec3_sub(world.pos, parent.pos)), 1.0f / parent.scale),
-      .rot = quat_mul(parent_inv_rot, world.rot),
-      .scale = world.scale / parent.scale,
-    };
+// brings the entity's own local and world in sync right away so gameplay code
+// can read them, children and _matrix catch up in scene_update_transforms
+void entity_transform_apply(Scene* scene, EntityHandle handle, EntityTransformUpdate update) {
+    PROFILE_ZONE("entity_transform_apply") {
+        struct TransformC* transform = entity_transform(scene, handle);
+        struct TransformC* parent = entity_transform(scene, entity_links(scene, handle)->parent);
+
+        if (update == ETU_LOCAL)
+        {
+            transform->world = parent ? transform_calculate_world(parent->world, transform->local) : transform->local;
+        }
+        else
+        {
+            transform->local = parent ? transform_calculate_local(parent->world, transform->world) : transform->world;
+        }
+
+        entity_transform_mark_dirty(scene, handle.index);
+    }
 }
 
-void entity_transform_apply(Entity* entity, Entity* parent, EntityTransformUpdate update) {
-    if (update == ETU_LOCAL)
-    {
-        entity->transform.world = parent ? transform_calculate_world(parent->transform.world, entity->transform.local) : entity->transform.local;
-        entity->transform._matrix = mat4_from_transform(&entity->transform.world);
+// levels bigger than this are split into jobs. a multiple of 4 that doesn't
+// depend on the thread count, so every entity lands in the same simd group
+// whether it runs on one thread or eight and results match bit for bit
+#define SCENE_TRANSFORM_BATCH 1024
+
+STRUCT(SceneTransformLevel) {
+    struct TransformC* transforms;
+    const u32* updated;
+    const u32* parents;
+};
+
+static void scene_transform_level_job(void* data, u32 start, u32 end) {
+    SceneTransformLevel* level = data;
+    transform_world_batch(level->transforms, level->updated + start, level->parents + start, end - start);
+}
+
+// recomputes world and _matrix for every entity marked since the last call and
+// for everything below it, queueing their instance data for the renderer. the
+// hierarchy array is depth sorted so this is one front to back walk; entities
+// that weren't marked and whose parent wasn't redone this pass are skipped.
+// free slots never show up, scene_destroy_entity takes them out of the
+// hierarchy. each depth level is collected first and handed to
+// transform_world_batch, nothing in a level depends on anything else in it so
+// big levels are spread over the job threads
+void scene_update_transforms(Scene* scene) {
+    if (!scene->transforms.n_dirty) return;
+
+    PROFILE_BEGIN("scene_update_transforms");
+
+    u32* order = slice_vektor(scene->hierarchy.order).start;
+    u8* flags = scene_column(scene, transform_flags);
+    ComponentType* components = scene_column(scene, components);
+    struct TransformC* transforms = scene_column(scene, transform);
+    struct EntityLinks* links = scene_column(scene, links);
+
+    u32* updated = mrw_alloc_n(memory.frame, u32, scene->hierarchy.n);
+    u32* parents = mrw_alloc_n(memory.frame, u32, scene->hierarchy.n);
+    u32 n_updated = 0;
+
+    u32 level_start = 0;
+    for (u32 depth = 0; depth < SCENE_MAX_DEPTH && level_start < scene->hierarchy.n; depth++) {
+        u32 level_end = scene->hierarchy.level_end[depth];
+        u32 first = n_updated;
+
+        for (u32 i = level_start; i < level_end; i++) {
+            u32 index = order[i];
+            EntityHandle parent = links[index].parent;
+
+            bool dirty = FLAG_HAS_ALL(flags[index], TF_Dirty);
+            bool parent_updated = parent.valid && FLAG_HAS_ALL(flags[parent.index], TF_Updated);
+            if (!dirty && (!parent_updated || FLAG_HAS_ANY(components[index], CT_IsHidden))) continue;
+
+            updated[n_updated] = index;
+            parents[n_updated] = parent.valid ? parent.index : TRANSFORM_NO_PARENT;
+            n_updated++;
+        }
+
+        u32 n_level = n_updated - first;
+        if (n_level > SCENE_TRANSFORM_BATCH) {
+            SceneTransformLevel level = { .transforms = transforms, .updated = updated + first, .parents = parents + first };
+            JobCounter counter = { 0 };
+            jobs_parallel_for(&counter, "scene_transform_level_job", n_level, SCENE_TRANSFORM_BATCH, scene_transform_level_job, &level);
+            job_wait(&counter);
+        } else {
+            transform_world_batch(transforms, updated + first, parents + first, n_level);
+        }
+        for (u32 i = first; i < n_updated; i++) {
+            FLAG_CLEAR(flags[updated[i]], TF_Dirty);
+            FLAG_SET(flags[updated[i]], TF_Updated);
+        }
+
+        level_start = level_end;
+    }
+
+    for (u32 i = 0; i < n_updated; i++) {
+        FLAG_CLEAR(flags[updated[i]], TF_Updated);
+        if (scene_instance_visible(components[updated[i]])) {
+            scene_instance_queue(scene, updated[i]);
+        }
+    }
+    scene->transforms.n_dirty = 0;
+
+    PROFILE_END();
+}
+
+static void scene_hierarchy_insert(Scene* scene, u32 index) {
+    u16 depth = scene_column(scene, depth)[index];
+
+    if (scene->hierarchy.n == scene->hierarchy.n_allocated) {
+        vektor_add(scene->hierarchy.order, 0u);
+        scene->hierarchy.n_allocated++;
+    }
+
+    u32* order = slice_vektor(scene->hierarchy.order).start;
+    u32* position = scene_column(scene, hierarchy_position);
+    u32* level_end = scene->hierarchy.level_end;
+
+    // order inside a level doesn't matter, so the free slot at the end of the
+    // array is walked up to the end of this depth by moving the first entry
+    // of every deeper level to that level's end
+    for (u32 d = SCENE_MAX_DEPTH - 1; d > depth; d--) {
+        u32 first = level_end[d - 1];
+        if (first != level_end[d]) {
+            order[level_end[d]] = order[first];
+            position[order[first]] = level_end[d];
+        }
+        level_end[d]++;
+    }
+    order[level_end[depth]] = index;
+    position[index] = level_end[depth];
+    level_end[depth]++;
+
+    scene->hierarchy.n++;
+}
+
+static void scene_hierarchy_remove(Scene* scene, u32 index) {
+    u16 depth = scene_column(scene, depth)[index];
+    u32* order = slice_vektor(scene->hierarchy.order).start;
+    u32* position = scene_column(scene, hierarchy_position);
+    u32* level_end = scene->hierarchy.level_end;
+
+    // the reverse of insert, the hole is filled by the last entry of its
+    // level and moves down to the end of the array the same way
+    u32 hole = position[index];
+    for (u32 d = depth; d < SCENE_MAX_DEPTH; d++) {
+        u32 last = --level_end[d];
+        if (last != hole) {
+            order[hole] = order[last];
+            position[order[hole]] = hole;
+        }
+        hole = last;
+    }
+
+    scene->hierarchy.n--;
+}
+
+// levels below index, 0 for an entity without children
+static u32 scene_hierarchy_height(Scene* scene, u32 index) {
+    struct EntityLinks* links = scene_column(scene, links);
+    u32 height = 0;
+    for (EntityHandle child = links[index].first_child; child.valid; child = links[child.index].next_sibling) {
+        height = max(height, scene_hierarchy_height(scene, child.index) + 1);
+    }
+    return height;
+}
+
+// moves a subtree to a new depth, parents are reinserted before their children.
+// callers check the subtree fits under SCENE_MAX_DEPTH
+static void scene_hierarchy_set_depth(Scene* scene, u32 index, u16 depth) {
+    scene_hierarchy_remove(scene, index);
+    scene_column(scene, depth)[index] = depth;
+    scene_hierarchy_insert(scene, index);
+
+    struct EntityLinks* links = scene_column(scene, links);
+    for (EntityHandle child = links[index].first_child; child.valid; child = links[child.index].next_sibling) {
+        scene_hierarchy_set_depth(scene, child.index, depth + 1);
     }
-    else
-    {
-        entity->transform.local = parent ? transform_calculate_local(parent->transform.world, entity->transform.world) : entity->transform.world;
+}
+
+static void entity_unlink(Scene* scene, EntityHandle handle) {
+    struct EntityLinks* links = entity_links(scene, handle);
+    struct EntityLinks* parent = entity_links(scene, links->parent);
+    if (parent) {
+        EntityHandle* next = &parent->first_child;
+        while (next->valid && next->index != handle.index) {
+            next = &entity_links(scene, *next)->next_sibling;
+        }
+        if (next->valid) *next = links->next_sibling;
     }
+    links->parent = (EntityHandle){ 0 };
+    links->next_sibling = (EntityHandle){ 0 };
+}
 
-    for_each_entity_children(entity, child) {
-        if (entity_has(child, CT_IsHidden)) continue;
-        entity_transform_apply(child, entity, ETU_LOCAL);
+// keeps the entity where it is in the world, its local is rebased onto the new parent.
+// parenting an entity to itself or one of its descendants, or deeper than
+// SCENE_MAX_DEPTH, is refused and leaves the hierarchy as it was
+void entity_set_parent(Scene* scene, EntityHandle handle, EntityHandle parent) {
+    bool has_parent = scene_entity_valid(scene, parent);
+    u32 depth = 0;
+    if (has_parent) {
+        struct EntityLinks* links = scene_column(scene, links);
+        for (EntityHandle up = parent; up.valid; up = links[up.index].parent) {
+            if (up.index == handle.index) {
+                mrw_error("entity_set_parent would make {} its own ancestor", handle.index);
+                return;
+            }
+        }
+        depth = scene_column(scene, depth)[parent.index] + 1;
+    }
+    if (depth + scene_hierarchy_height(scene, handle.index) >= SCENE_MAX_DEPTH) {
+        mrw_error("entity_set_parent would nest {} deeper than {}", handle.index, (u32)SCENE_MAX_DEPTH);
+        return;
+    }
+
+    entity_unlink(scene, handle);
+
+    struct EntityLinks* links = entity_links(scene, handle);
+    if (has_parent) {
+        struct EntityLinks* parent_links = entity_links(scene, parent);
+        links->parent = parent;
+        links->next_sibling = parent_links->first_child;
+        parent_links->first_child = handle;
+    }
+
+    scene_hierarchy_set_depth(scene, handle.index, depth);
+
+    if (entity_has(scene, handle, CT_Transform)) {
+        entity_transform_apply(scene, handle, ETU_WORLD);
     }
 }
 
-void entity_transform_apply_local(Entity* entity) {
-    entity_transform_apply(entity, scene_get_entity(entity->scene, entity->parent), ETU_LOCAL);
+void entity_transform_apply_local(Scene* scene, EntityHandle handle) {
+    entity_transform_apply(scene, handle, ETU_LOCAL);
 }
 
-void entity_transform_apply_world(Entity* entity) {
-    entity_transform_apply(entity, scene_get_entity(entity->scene, entity->parent), ETU_WORLD);
+void entity_transform_apply_world(Scene* scene, EntityHandle handle) {
+    entity_transform_apply(scene, handle, ETU_WORLD);
 }
 
-void entity_set_hidden(Entity* entity, bool val) {
+void entity_set_hidden(Scene* scene, EntityHandle handle, bool val) {
     if (val) {
-        entity_enable_components(entity, CT_IsHidden);
+        entity_enable_components(scene, handle, CT_IsHidden);
     }
     else {
-        entity_disable_components(entity, CT_IsHidden);
-        entity_transform_apply_world(entity);
+        entity_disable_components(scene, handle, CT_IsHidden);
+        entity_transform_apply_world(scene, handle);
+    }
+}
+
+static u32 scene_alloc_slot(Scene* scene) {
+    u32 index = scene->entities.first_free;
+    if (index != SCENE_NO_SLOT) {
+        // free slots are chained through their links column
+        scene->entities.first_free = scene_column(scene, links)[index].next_sibling.index;
+        return index;
     }
+
+    index = scene->entities.n_slots++;
+    vektor_add(scene->entities.generation, 0u);
+    vektor_add(scene->entities.components, (ComponentType)0);
+    vektor_add(scene->entities.name, (str){ 0 });
+    vektor_add(scene->entities.links, (struct EntityLinks){ 0 });
+    vektor_add(scene->entities.transform, (struct TransformC){ 0 });
+    vektor_add(scene->entities.transform_flags, (u8)0);
+    vektor_add(scene->entities.depth, (u16)0);
+    vektor_add(scene->entities.hierarchy_position, 0u);
+    vektor_add(scene->entities.mesh, (struct MeshC){ 0 });
+    vektor_add(scene->entities.physics, (struct PhysicsC){ 0 });
+    vektor_add(scene->entities.planet, (struct PlanetC){ 0 });
+    vektor_add(scene->entities.camera, (struct CameraC){ 0 });
+
+    SceneQuery* queries = slice_vektor(scene->queries).start;
+    for (u32 q = 0; q < scene->n_queries; q++) {
+        vektor_add(queries[q].membership, (u8)SQM_None);
+    }
+    return index;
 }
 
-EntityHandle _scene_create_entity(Scene* scene, EntityHandle handle) {
-    Entity* entity = scene_get_entity(scene, handle);
-    entity->scene = scene;
+EntityHandle _scene_create_entity(Scene* scene, EntityDesc desc) {
+    if (desc.parent.valid && scene_column(scene, depth)[desc.parent.index] + 1u >= SCENE_MAX_DEPTH) {
+        mrw_error("scene_create_entity would nest a child of {} deeper than {}", desc.parent.index, (u32)SCENE_MAX_DEPTH);
+        return (EntityHandle){ 0 };
+    }
+
+    u32 index = scene_alloc_slot(scene);
+    scene_column(scene, generation)[index]++;
+    EntityHandle handle = scene_entity_handle(scene, index);
 
-    if (entity->parent.valid) {
-        Entity* parent = scene_get_entity(scene, entity->parent);
-        entity->next_sibling = parent->first_child;
+    scene_column(scene, transform_flags)[index] = 0;
+    scene_column(scene, mesh)[index] = desc.mesh;
+    scene_set_components(scene, index, desc.components);
+    scene_column(scene, name)[index] = desc.name;
+    scene_column(scene, links)[index] = (struct EntityLinks){ .parent = desc.parent };
+    scene_column(scene, transform)[index] = desc.transform;
+    scene_column(scene, depth)[index] = 0;
+    scene_column(scene, physics)[index] = desc.physics;
+    scene_column(scene, planet)[index] = desc.planet;
+    scene_column(scene, camera)[index] = desc.camera;
+
+    if (desc.parent.valid) {
+        struct EntityLinks* parent = entity_links(scene, desc.parent);
+        scene_column(scene, links)[index].next_sibling = parent->first_child;
         parent->first_child = handle;
+        scene_column(scene, depth)[index] = scene_column(scene, depth)[desc.parent.index] + 1;
     }
 
-    if (entity_has(entity, CT_Transform)) {
-        if (entity->transform.local.scale == 0.0f) {
-            entity->transform.world.rot = quat_normalize(entity->transform.world.rot);
-            if (entity->transform.world.scale == 0.0f) entity->transform.world.scale = 1.0f;
-            entity_transform_apply_world(entity);
-            entity->transform._matrix = mat4_from_transform(&entity->transform.world);
+    scene_hierarchy_insert(scene, index);
+
+    if (FLAG_HAS_ALL(desc.components, CT_Transform)) {
+        struct TransformC* transform = entity_transform(scene, handle);
+        if (transform->local.scale == 0.0f) {
+            transform->world.rot = quat_normalize(transform->world.rot);
+            if (transform->world.scale == 0.0f) transform->world.scale = 1.0f;
+            entity_transform_apply_world(scene, handle);
         }
         else  {
-            entity->transform.local.rot = quat_normalize(entity->transform.local.rot);
-            if (entity->transform.local.scale == 0.0f) entity->transform.local.scale = 1.0f;
-            entity_transform_apply_local(entity);
+            transform->local.rot = quat_normalize(transform->local.rot);
+            if (transform->local.scale == 0.0f) transform->local.scale = 1.0f;
+            entity_transform_apply_local(scene, handle);
         }
     }
 
@@ -102,23 +642,79 @@ EntityHandle _scene_create_entity(Scene* scene, EntityHandle handle) {
 }
 
 #define scene_create_entity(_scene, _comps, ...)\
-    _scene_create_entity((_scene), genarr_add((_scene)->entities, (Entity){ .components = (_comps), __VA_ARGS__ }))
+    _scene_create_entity((_scene), (EntityDesc){ .components = (_comps), __VA_ARGS__ })
+
+// unlinks the entity from its parent, its children are destroyed with it
+void scene_destroy_entity(Scene* scene, EntityHandle handle) {
+    if (!scene_entity_valid(scene, handle)) return;
+
+    struct EntityLinks* links = entity_links(scene, handle);
+
+    while (links->first_child.valid) {
+        scene_destroy_entity(scene, links->first_child);
+    }
+
+    entity_unlink(scene, handle);
+
+    u32 index = handle.index;
+    scene_hierarchy_remove(scene, index);
+
+    scene_set_components(scene, index, 0);
+
+    u8* flags = &scene_column(scene, transform_flags)[index];
+    if (FLAG_HAS_ALL(*flags, TF_Dirty)) scene->transforms.n_dirty--;
+    *flags = 0;
+
+    scene_column(scene, generation)[index]++;
+    scene_column(scene, links)[index] = (struct EntityLinks){ .next_sibling.index = scene->entities.first_free };
+    scene->entities.first_free = index;
+}
 
 STRUCT(EntityIter) {
-    GENARR_ITER_ALIAS(Entity, entity);
     ComponentType include;
     ComponentType any;
     ComponentType exclude;
+
+    // slot of the current entity, for indexing scene_column directly
+    u32 index;
+    EntityHandle handle;
+
+    u32 _query;
+    u32 _next;
 };
 
+// once a frame after everything that iterates the scene, iterators can stop
+// early so there's no telling from inside scene_next_entity that none is live.
+// queries that are more than half stale get compacted
+void scene_end_frame(Scene* scene) {
+    SceneQuery* queries = slice_vektor(scene->queries).start;
+    for (u32 q = 0; q < scene->n_queries; q++) {
+        if (queries[q].n_stale > queries[q].n_entities / 2) {
+            scene_query_compact(&queries[q]);
+        }
+    }
+}
+
+// walks the cached query for the iterator's flags, the query is built with a
+// full scan the first time a combination is used and maintained incrementally
+// after that
 bool scene_next_entity(Scene* scene, EntityIter* iter) {
-    FLAG_SET(iter->exclude, CT_IsHidden);
-    FLAG_CLEAR(iter->exclude, iter->include);
-    while (genarr_next_valid(scene->entities, iter)) {
-        ComponentType comps = iter->entity->components;
-        if (FLAG_HAS_ANY(comps, iter->exclude)) continue;
-        if (iter->any && FLAG_HAS_ANY(comps, iter->any)) return true;
-        if (!FLAG_HAS_ALL(comps, iter->include)) continue;
+    if (!iter->_query) {
+        FLAG_SET(iter->exclude, CT_IsHidden);
+        FLAG_CLEAR(iter->exclude, iter->include);
+
+        SceneQuery* query = scene_get_query(scene, iter->include, iter->any, iter->exclude);
+        iter->_query = (u32)(query - slice_vektor(scene->queries).start) + 1;
+    }
+
+    SceneQuery* query = &slice_vektor(scene->queries).start[iter->_query - 1];
+    u32* entities = slice_vektor(query->entities).start;
+    u8* membership = slice_vektor(query->membership).start;
+    while (iter->_next < query->n_entities) {
+        u32 index = entities[iter->_next++];
+        if (membership[index] != SQM_Member) continue;
+        iter->index = index;
+        iter->handle = scene_entity_handle(scene, index);
         return true;
     }
     return false;
@@ -0,0 +1,370 @@
+#define FLOS_SHADERS
+#include "base.c"
+
+// shaders are looked up by name and referred to by a ShaderHandle, an index
+// that stays the same for the whole run. what's behind a handle can change:
+// pipelines are cached by shaders_pipeline_key, registrations that come out
+// the same share one, and a hot reload swaps a new one in underneath. binding
+// layouts are created through shaders_create_binding_layout so the key can
+// cover what's in them
+//
+// hot reload watches SHADERS_DIR with inotify. a write marks every shader
+// whose source or one of its includes has that name, a job rereads and hashes
+// their files and only the ones whose sources really changed get a new
+// pipeline. compiling stays on the main thread between frames, reni's device
+// calls go through the frame allocator
+
+#if defined(__linux__) && !defined(FLOS_HEADLESS)
+#include <sys/inotify.h>
+#include <unistd.h>
+#define SHADERS_HOT_RELOAD
+#endif
+
+#define SHADERS_MAX 32
+#define SHADERS_MAX_LAYOUTS 16
+#define SHADERS_DIR "./res/shaders"
+
+STRUCT(ShaderHandle) {
+    u32 index;
+};
+
+// key hashes every entry's visibility and its buffer, texture and sampler types
+STRUCT(ShaderLayout) {
+    ReniBindingLayout layout;
+    u64 key;
+};
+
+STRUCT(ShaderPipeline) {
+    u64 key;
+    ReniShader shader;
+    u32 n_users;
+};
+
+STRUCT(Shader) {
+    // has to outlive the registry, names are literals
+    str name;
+    bool registered;
+    ReniShaderConfig config;
+    u32 pipeline;
+    // of the source and include files as last compiled
+    u64 source_hash;
+
+    // set from inotify, handed to the reload job as reloading
+    bool stale;
+    bool reloading;
+    // written by the reload job
+    u64 next_hash;
+};
+
+STRUCT(ShaderStats) {
+    u32 n_compiled;
+    u32 n_cache_hits;
+    u32 n_reloaded;
+};
+
+struct {
+    Shader shaders[SHADERS_MAX];
+    u32 n_shaders;
+    ShaderPipeline pipelines[SHADERS_MAX];
+    ShaderLayout layouts[SHADERS_MAX_LAYOUTS];
+    u32 n_layouts;
+    ShaderStats stats;
+    // set by shaders_build_error while reni_create_shader runs
+    bool build_failed;
+
+#ifdef SHADERS_HOT_RELOAD
+    i32 inotify;
+    JobCounter reload;
+    bool reloading;
+#endif // SHADERS_HOT_RELOAD
+} shaders = { 0 };
+
+// the handle for name, reserved on first use so meshes can refer to a shader
+// before, or without (headless), it being registered
+ShaderHandle shaders_find(str name) {
+    for (u32 i = 0; i < shaders.n_shaders; i++) {
+        if (str_cmp(shaders.shaders[i].name, name) == 0) return (ShaderHandle){ i };
+    }
+    if (shaders.n_shaders == SHADERS_MAX) mrw_error("Out of shaders ({})", (u32)SHADERS_MAX);
+
+    shaders.shaders[shaders.n_shaders] = (Shader){ .name = name };
+    return (ShaderHandle){ shaders.n_shaders++ };
+}
+
+static cstr shaders_file_name(cstr path) {
+    cstr slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+// streams the file through a fixed buffer so jobs can call it
+static u64 shaders_hash_file(u64 hash, cstr path) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return hash;
+    u8 buffer[4096];
+    usize n;
+    while ((n = fread(buffer, 1, sizeof(buffer), fp))) {
+        hash = hash_bytes(hash, buffer, n);
+    }
+    fclose(fp);
+    return hash;
+}
+
+u64 shaders_source_hash(const ReniShaderConfig* config) {
+    u64 hash = shaders_hash_file(HASH_INIT, config->source.file.path);
+    cstr* includes = config->source.file.includes.start;
+    for (usize i = 0; i < slice_count(config->source.file.includes); i++) {
+        hash = shaders_hash_file(hash, includes[i]);
+    }
+    return hash;
+}
+
+static u64 shaders_hash_u32(u64 hash, u32 value) {
+    return hash_bytes(hash, &value, sizeof(value));
+}
+
+static u64 shaders_hash_blend(u64 hash, WGPUBlendComponent blend) {
+    hash = shaders_hash_u32(hash, (u32)blend.operation);
+    hash = shaders_hash_u32(hash, (u32)blend.srcFactor);
+    return shaders_hash_u32(hash, (u32)blend.dstFactor);
+}
+
+ReniBindingLayout shaders_create_binding_layout(Reni* reni, ReniBindingLayoutConfig config) {
+    if (shaders.n_layouts == SHADERS_MAX_LAYOUTS) mrw_error("Out of binding layouts ({})", (u32)SHADERS_MAX_LAYOUTS);
+
+    u64 key = HASH_INIT;
+    for (u32 i = 0; i < array_len(config.entries); i++) {
+        key = shaders_hash_u32(key, (u32)config.entries[i].visibility);
+        key = shaders_hash_u32(key, (u32)config.entries[i].buffer.type);
+        key = shaders_hash_u32(key, (u32)config.entries[i].texture.type);
+        key = shaders_hash_u32(key, (u32)config.entries[i].sampler.type);
+    }
+    ReniBindingLayout layout = reni_create_binding_layout(reni, config);
+    shaders.layouts[shaders.n_layouts++] = (ShaderLayout){ .layout = layout, .key = key };
+    return layout;
+}
+
+// layouts are only compared, what goes into the key is what's in them. unset
+// slots and layouts made around shaders_create_binding_layout count as empty
+static u64 shaders_layout_key(ReniBindingLayout layout) {
+    for (u32 i = 0; i < shaders.n_layouts; i++) {
+        if (memcmp(&shaders.layouts[i].layout, &layout, sizeof(layout)) == 0) return shaders.layouts[i].key;
+    }
+    return 0;
+}
+
+// the sources plus everything that ends up in the pipeline: entry points,
+// vertex strides and attributes, target formats and blending, the depth
+// format and the binding layouts. field by field, so padding and handle
+// values never reach the key
+u64 shaders_pipeline_key(const ReniShaderConfig* config, u64 source_hash) {
+    u64 hash = hash_bytes(HASH_INIT, &source_hash, sizeof(source_hash));
+    hash = hash_bytes(hash, config->source.file.path, strlen(config->source.file.path));
+    hash = hash_bytes(hash, config->vertex.entry.start, slice_size(config->vertex.entry));
+    hash = hash_bytes(hash, config->fragment.entry.start, slice_size(config->fragment.entry));
+
+    for (u32 i = 0; i < array_len(config->vertex.buffers); i++) {
+        hash = shaders_hash_u32(hash, (u32)config->vertex.buffers[i].stride);
+        for (u32 a = 0; a < array_len(config->vertex.buffers[i].attributes); a++) {
+            hash = shaders_hash_u32(hash, (u32)config->vertex.buffers[i].attributes[a].location);
+            hash = shaders_hash_u32(hash, (u32)config->vertex.buffers[i].attributes[a].offset);
+            hash = shaders_hash_u32(hash, (u32)config->vertex.buffers[i].attributes[a].format);
+        }
+    }
+    for (u32 i = 0; i < array_len(config->fragment.targets); i++) {
+        hash = shaders_hash_u32(hash, (u32)config->fragment.targets[i].format);
+        hash = shaders_hash_blend(hash, config->fragment.targets[i].blend_state.color);
+        hash = shaders_hash_blend(hash, config->fragment.targets[i].blend_state.alpha);
+    }
+    hash = shaders_hash_u32(hash, (u32)config->fragment.depth_format);
+    for (u32 i = 0; i < array_len(config->layouts); i++) {
+        u64 key = shaders_layout_key(config->layouts[i]);
+        hash = hash_bytes(hash, &key, sizeof(key));
+    }
+    return hash;
+}
+
+static void shaders_release_pipeline(Reni* reni, u32 pipeline) {
+    ShaderPipeline* p = &shaders.pipelines[pipeline];
+    if (--p->n_users) return;
+    reni_release_shader(reni, p->shader);
+    *p = (ShaderPipeline){ 0 };
+}
+
+// reni reports a shader that doesn't compile through its error callback,
+// render_error_callback passes it on while reni_create_shader is running
+void shaders_build_error(void) {
+    shaders.build_failed = true;
+}
+
+// points shader at the pipeline for its config and source_hash, compiling
+// one only when no other shader already has it. false when reni reported an
+// error while compiling, shader still points at the broken pipeline
+static bool shaders_build(Reni* reni, Shader* shader) {
+    u64 key = shaders_pipeline_key(&shader->config, shader->source_hash);
+
+    u32 empty = SHADERS_MAX;
+    for (u32 i = 0; i < SHADERS_MAX; i++) {
+        ShaderPipeline* p = &shaders.pipelines[i];
+        if (p->n_users && p->key == key) {
+            p->n_users++;
+            shader->pipeline = i;
+            shaders.stats.n_cache_hits++;
+            return true;
+        }
+        if (!p->n_users && empty == SHADERS_MAX) empty = i;
+    }
+    if (empty == SHADERS_MAX) mrw_error("Out of shader pipelines ({})", (u32)SHADERS_MAX);
+
+    PROFILE_BEGIN("shaders_build");
+    shaders.build_failed = false;
+    shaders.pipelines[empty] = (ShaderPipeline){
+        .key = key,
+        .shader = reni_create_shader(reni, shader->config),
+        .n_users = 1,
+    };
+    shader->pipeline = empty;
+    shaders.stats.n_compiled++;
+    PROFILE_END();
+    return !shaders.build_failed;
+}
+
+void shaders_register(Reni* reni, ShaderHandle handle, ReniShaderConfig config) {
+    Shader* shader = &shaders.shaders[handle.index];
+    if (shader->registered) shaders_release_pipeline(reni, shader->pipeline);
+
+    shader->config = config;
+    shader->source_hash = shaders_source_hash(&config);
+    shader->registered = true;
+    // nothing older to fall back on, it's drawn with whatever reni made of it
+    if (!shaders_build(reni, shader)) mrw_debug("shaders: {} failed to build", shader->name);
+}
+
+ReniShader shaders_get(ShaderHandle handle) {
+    Shader* shader = &shaders.shaders[handle.index];
+    if (!shader->registered) {
+        mrw_error("Shader {} used before it was registered", shader->name);
+        return (ReniShader){ 0 };
+    }
+    return shaders.pipelines[shader->pipeline].shader;
+}
+
+#ifdef SHADERS_HOT_RELOAD
+
+static void shaders_watch(void) {
+    shaders.inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (shaders.inotify < 0 || inotify_add_watch(shaders.inotify, SHADERS_DIR, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        mrw_debug("shaders: hot reload off, couldn't watch {}", SHADERS_DIR);
+    }
+}
+
+static bool shaders_uses_file(Shader* shader, cstr name) {
+    if (strcmp(shaders_file_name(shader->config.source.file.path), name) == 0) return true;
+    cstr* includes = shader->config.source.file.includes.start;
+    for (usize i = 0; i < slice_count(shader->config.source.file.includes); i++) {
+        if (strcmp(shaders_file_name(includes[i]), name) == 0) return true;
+    }
+    return false;
+}
+
+// editors save in bursts, a file can show up several times in one read
+static void shaders_read_events(void) {
+    if (shaders.inotify < 0) return;
+
+    _Alignas(struct inotify_event) u8 buffer[4096];
+    ssize_t size;
+    while ((size = read(shaders.inotify, buffer, sizeof(buffer))) > 0) {
+        for (usize offset = 0; offset < (usize)size;) {
+            const struct inotify_event* event = (const struct inotify_event*)(buffer + offset);
+            offset += sizeof(struct inotify_event) + event->len;
+            if (!event->len) continue;
+
+            for (u32 i = 0; i < shaders.n_shaders; i++) {
+                Shader* shader = &shaders.shaders[i];
+                if (shader->registered && shaders_uses_file(shader, event->name)) shader->stale = true;
+            }
+        }
+    }
+}
+
+static void shaders_reload_job(void* data, u32 start, u32 end) {
+    (void)data;
+    for (u32 i = start; i < end; i++) {
+        Shader* shader = &shaders.shaders[i];
+        if (shader->reloading) shader->next_hash = shaders_source_hash(&shader->config);
+    }
+}
+
+// rebuilds what the last reload job found changed, then hands whatever went
+// stale since to a new one
+static void shaders_reload(Reni* reni) {
+    if (atomic_load_explicit(&shaders.reload.pending, memory_order_acquire)) return;
+
+    if (shaders.reloading) {
+        shaders.reloading = false;
+        for (u32 i = 0; i < shaders.n_shaders; i++) {
+            Shader* shader = &shaders.shaders[i];
+            if (!shader->reloading) continue;
+            shader->reloading = false;
+            if (shader->next_hash == shader->source_hash) continue;
+
+            // a broken edit keeps the old pipeline, source_hash stays so the
+            // next save of the file tries again
+            u32 old = shader->pipeline;
+            u64 old_hash = shader->source_hash;
+            shader->source_hash = shader->next_hash;
+            if (!shaders_build(reni, shader)) {
+                shaders_release_pipeline(reni, shader->pipeline);
+                shader->pipeline = old;
+                shader->source_hash = old_hash;
+                mrw_debug("shaders: {} failed to build, keeping the old one", shader->name);
+                continue;
+            }
+            shaders_release_pipeline(reni, old);
+            shaders.stats.n_reloaded++;
+            mrw_debug("shaders: reloaded {}", shader->name);
+        }
+    }
+
+    shaders_read_events();
+
+    bool any = false;
+    for (u32 i = 0; i < shaders.n_shaders; i++) {
+        Shader* shader = &shaders.shaders[i];
+        shader->reloading = shader->stale;
+        shader->stale = false;
+        any |= shader->reloading;
+    }
+    if (!any) return;
+
+    shaders.reloading = true;
+    jobs_push((Job){
+        .name = "shaders_reload_job",
+        .fn = shaders_reload_job,
+        .end = shaders.n_shaders,
+        .counter = &shaders.reload,
+    });
+}
+
+#endif // SHADERS_HOT_RELOAD
+
+void shaders_init(void) {
+#ifdef SHADERS_HOT_RELOAD
+    shaders_watch();
+#endif // SHADERS_HOT_RELOAD
+}
+
+void shaders_shutdown(void) {
+#ifdef SHADERS_HOT_RELOAD
+    job_wait(&shaders.reload);
+    if (shaders.inotify >= 0) close(shaders.inotify);
+#endif // SHADERS_HOT_RELOAD
+}
+
+// once a frame before anything is recorded
+void shaders_poll(Reni* reni) {
+#ifdef SHADERS_HOT_RELOAD
+    shaders_reload(reni);
+#else // SHADERS_HOT_RELOAD
+    (void)reni;
+#endif // SHADERS_HOT_RELOAD
+}
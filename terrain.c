@@ -0,0 +1,475 @@
+#define FLOS_TERRAIN
+#include "base.c"
+
+// cube-sphere planet terrain. every cube face is a quadtree of chunks, a leaf
+// is split while the camera is closer than a few chunk sizes and merged back
+// once it moves away. chunk meshes are displaced by terrain_height, the same
+// function physics samples for the ground, and built as jobs
+//
+// a split keeps the parent drawn until all four children have their meshes, a
+// merge shows the parent again right away since its mesh is kept around while
+// it has children. skirts hide the cracks between neighbouring depths
+//
+// everything is in the planet's local space. chunks aren't entities, their
+// meshes share the planet's instances so they follow its transform and all
+// draw with one binding
+
+// vertices along one chunk edge
+#define TERRAIN_GRID 17
+#define TERRAIN_RING (4 * (TERRAIN_GRID - 1))
+#define TERRAIN_CHUNK_VERTICES (TERRAIN_GRID * TERRAIN_GRID + TERRAIN_RING)
+#define TERRAIN_CHUNK_INDICES ((TERRAIN_GRID - 1) * (TERRAIN_GRID - 1) * 6 + TERRAIN_RING * 6)
+
+#define TERRAIN_MAX_NODES 4096
+#define TERRAIN_MAX_DEPTH 10
+#define TERRAIN_NO_NODE 0xFFFFFFFFu
+#define TERRAIN_N_JOBS 64
+#define TERRAIN_OCTAVES 6
+
+// split while closer than this many chunk sizes, merge past it times the hysteresis
+#define TERRAIN_SPLIT_DISTANCE 2.5f
+#define TERRAIN_MERGE_HYSTERESIS 1.25f
+// how far skirts hang below the surface, relative to the chunk size
+#define TERRAIN_SKIRT 0.05f
+
+STRUCT(TerrainFace) {
+    vec3s normal, u, v;
+};
+
+// u x v = normal, so grid triangles wind counter clockwise seen from outside
+static const TerrainFace terrain_faces[6] = {
+    { .normal = {{  1,  0,  0 }}, .u = {{ 0, 1, 0 }}, .v = {{ 0, 0, 1 }} },
+    { .normal = {{ -1,  0,  0 }}, .u = {{ 0, 0, 1 }}, .v = {{ 0, 1, 0 }} },
+    { .normal = {{  0,  1,  0 }}, .u = {{ 0, 0, 1 }}, .v = {{ 1, 0, 0 }} },
+    { .normal = {{  0, -1,  0 }}, .u = {{ 1, 0, 0 }}, .v = {{ 0, 0, 1 }} },
+    { .normal = {{  0,  0,  1 }}, .u = {{ 1, 0, 0 }}, .v = {{ 0, 1, 0 }} },
+    { .normal = {{  0,  0, -1 }}, .u = {{ 0, 1, 0 }}, .v = {{ 1, 0, 0 }} },
+};
+
+STRUCT(TerrainNode) {
+    u32 parent;
+    // first of four consecutive nodes, TERRAIN_NO_NODE for leaves
+    u32 children;
+
+    u8 face;
+    u8 depth;
+    u32 x, y;
+
+    // bumped when the node is freed so a chunk finishing afterwards is dropped
+    u32 generation;
+    bool queued;
+    bool has_mesh;
+    bool visible;
+    // all four children can stand in for this node
+    bool children_ready;
+    MeshHandle mesh;
+
+    vec3s center;
+    f32 size;
+};
+
+typedef enum {
+    TJ_Free,
+    // pushed to the job system, possibly being built
+    TJ_Queued,
+    TJ_Done,
+} TerrainJobState;
+
+// only the main thread moves a job out of TJ_Free and TJ_Done, the chunk job
+// only moves it from TJ_Queued to TJ_Done
+STRUCT(TerrainJob) {
+    atomic_uint state;
+    Terrain* terrain;
+    u32 node;
+    u32 generation;
+    u8 face;
+    u8 depth;
+    u32 x, y;
+    Vertex vertices[TERRAIN_CHUNK_VERTICES];
+};
+
+STRUCT(Terrain) {
+    u32 seed;
+    f32 amplitude;
+    f32 frequency;
+    EntityHandle planet;
+
+    TerrainNode* nodes;
+    u32 n_nodes;
+    u32* free_blocks;
+    u32 n_free_blocks;
+
+    TerrainJob* jobs;
+    JobCounter chunks;
+};
+
+// shared by every chunk, the grid first and then the skirt quads
+static u16 terrain_indices[TERRAIN_CHUNK_INDICES];
+
+static f32 terrain_lattice(u32 seed, i32 x, i32 y, i32 z) {
+    u32 h = seed ^ ((u32)x * 0x8da6b343u) ^ ((u32)y * 0xd8163841u) ^ ((u32)z * 0xcb1ab31fu);
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return (f32)(h >> 8) * (2.0f / 16777216.0f) - 1.0f;
+}
+
+// trilinear value noise in [-1, 1]
+static f32 terrain_noise(u32 seed, vec3s p) {
+    f32 fx = floorf(p.x), fy = floorf(p.y), fz = floorf(p.z);
+    i32 x = (i32)fx, y = (i32)fy, z = (i32)fz;
+    f32 tx = p.x - fx, ty = p.y - fy, tz = p.z - fz;
+    tx = tx * tx * (3.0f - 2.0f * tx);
+    ty = ty * ty * (3.0f - 2.0f * ty);
+    tz = tz * tz * (3.0f - 2.0f * tz);
+
+    f32 c[2][2];
+    for (i32 j = 0; j < 2; j++) {
+        for (i32 k = 0; k < 2; k++) {
+            f32 a = terrain_lattice(seed, x, y + j, z + k);
+            f32 b = terrain_lattice(seed, x + 1, y + j, z + k);
+            c[j][k] = a + (b - a) * tx;
+        }
+    }
+    f32 c0 = c[0][0] + (c[1][0] - c[0][0]) * ty;
+    f32 c1 = c[0][1] + (c[1][1] - c[0][1]) * ty;
+    return c0 + (c1 - c0) * tz;
+}
+
+// surface radius along a unit direction in the planet's local space
+f32 terrain_height(Terrain* terrain, vec3s dir) {
+    f32 h = 0.0f;
+    f32 amplitude = 0.5f;
+    f32 frequency = terrain->frequency;
+    for (u32 octave = 0; octave < TERRAIN_OCTAVES; octave++) {
+        h += amplitude * terrain_noise(terrain->seed + octave, vec3_scale(dir, frequency));
+        amplitude *= 0.5f;
+        frequency *= 2.0f;
+    }
+    return 1.0f + terrain->amplitude * h;
+}
+
+// s, t in [0, 1] across the face, spherified so cells stay close to square
+static vec3s terrain_face_dir(u8 face, f32 s, f32 t) {
+    TerrainFace f = terrain_faces[face];
+    vec3s p = vec3_add(f.normal, vec3_add(vec3_scale(f.u, s * 2.0f - 1.0f), vec3_scale(f.v, t * 2.0f - 1.0f)));
+    f32 x2 = p.x * p.x, y2 = p.y * p.y, z2 = p.z * p.z;
+    return (vec3s){
+        .x = p.x * sqrtf(1.0f - y2 * 0.5f - z2 * 0.5f + y2 * z2 / 3.0f),
+        .y = p.y * sqrtf(1.0f - z2 * 0.5f - x2 * 0.5f + z2 * x2 / 3.0f),
+        .z = p.z * sqrtf(1.0f - x2 * 0.5f - y2 * 0.5f + x2 * y2 / 3.0f),
+    };
+}
+
+static vec3s terrain_surface_point(Terrain* terrain, u8 face, f32 s, f32 t) {
+    vec3s dir = terrain_face_dir(face, s, t);
+    return vec3_scale(dir, terrain_height(terrain, dir));
+}
+
+// grid position i, j of a chunk, may be one past the edge for normals
+static vec3s terrain_chunk_point(Terrain* terrain, TerrainJob* job, i32 i, i32 j) {
+    f32 cells = (f32)(1u << job->depth);
+    f32 s = ((f32)job->x + (f32)i / (TERRAIN_GRID - 1)) / cells;
+    f32 t = ((f32)job->y + (f32)j / (TERRAIN_GRID - 1)) / cells;
+    return terrain_surface_point(terrain, job->face, s, t);
+}
+
+// border of the grid walked once around, skirts hang off these in order
+static u32 terrain_ring_index(u32 r) {
+    u32 side = r / (TERRAIN_GRID - 1);
+    u32 k = r % (TERRAIN_GRID - 1);
+    u32 last = TERRAIN_GRID - 1;
+    switch (side) {
+        case 0: return k;
+        case 1: return last + k * TERRAIN_GRID;
+        case 2: return (last - k) + last * TERRAIN_GRID;
+        default: return (last - k) * TERRAIN_GRID;
+    }
+}
+
+static void terrain_init_indices(void) {
+    u32 n = 0;
+    for (u32 j = 0; j < TERRAIN_GRID - 1; j++) {
+        for (u32 i = 0; i < TERRAIN_GRID - 1; i++) {
+            u16 a = j * TERRAIN_GRID + i;
+            u16 b = a + 1;
+            u16 c = a + TERRAIN_GRID + 1;
+            u16 d = a + TERRAIN_GRID;
+            u16 quad[] = { a, b, c, a, c, d };
+            buf_copy(terrain_indices + n, quad, sizeof(quad));
+            n += array_len(quad);
+        }
+    }
+
+    u16 skirt = TERRAIN_GRID * TERRAIN_GRID;
+    for (u32 r = 0; r < TERRAIN_RING; r++) {
+        u32 next = (r + 1) % TERRAIN_RING;
+        u16 a = terrain_ring_index(r);
+        u16 b = terrain_ring_index(next);
+        u16 quad[] = { a, skirt + r, b, b, skirt + r, skirt + next };
+        buf_copy(terrain_indices + n, quad, sizeof(quad));
+        n += array_len(quad);
+    }
+}
+
+static void terrain_build_chunk(Terrain* terrain, TerrainJob* job) {
+    PROFILE_BEGIN("terrain_build_chunk");
+
+    // one extra row all around so edge normals match the neighbouring chunk
+    vec3s points[TERRAIN_GRID + 2][TERRAIN_GRID + 2];
+    for (i32 j = -1; j <= TERRAIN_GRID; j++) {
+        for (i32 i = -1; i <= TERRAIN_GRID; i++) {
+            points[j + 1][i + 1] = terrain_chunk_point(terrain, job, i, j);
+        }
+    }
+
+    for (u32 j = 0; j < TERRAIN_GRID; j++) {
+        for (u32 i = 0; i < TERRAIN_GRID; i++) {
+            vec3s du = vec3_sub(points[j + 1][i + 2], points[j + 1][i]);
+            vec3s dv = vec3_sub(points[j + 2][i + 1], points[j][i + 1]);
+            job->vertices[j * TERRAIN_GRID + i] = (Vertex){
+                .position = points[j + 1][i + 1],
+                .normal = vec3_normalize(vec3_cross(du, dv)),
+            };
+        }
+    }
+
+    f32 skirt = 1.0f - TERRAIN_SKIRT * 2.0f / (f32)(1u << job->depth);
+    for (u32 r = 0; r < TERRAIN_RING; r++) {
+        Vertex edge = job->vertices[terrain_ring_index(r)];
+        job->vertices[TERRAIN_GRID * TERRAIN_GRID + r] = (Vertex){
+            .position = vec3_scale(edge.position, skirt),
+            .normal = edge.normal,
+        };
+    }
+
+    PROFILE_END();
+}
+
+static void terrain_chunk_job(void* data, u32 start, u32 end) {
+    TerrainJob* job = data;
+    terrain_build_chunk(job->terrain, job);
+    atomic_store_explicit(&job->state, TJ_Done, memory_order_release);
+}
+
+static void terrain_node_init(Terrain* terrain, u32 n, u32 parent, u8 face, u8 depth, u32 x, u32 y) {
+    TerrainNode* node = &terrain->nodes[n];
+    u32 generation = node->generation;
+    f32 cells = (f32)(1u << depth);
+    *node = (TerrainNode){
+        .parent = parent,
+        .children = TERRAIN_NO_NODE,
+        .face = face,
+        .depth = depth,
+        .x = x,
+        .y = y,
+        .generation = generation,
+        .center = terrain_surface_point(terrain, face, ((f32)x + 0.5f) / cells, ((f32)y + 0.5f) / cells),
+        // a face spans about a quarter of the circumference
+        .size = (f32)M_PI * 0.5f / cells,
+    };
+}
+
+void terrain_init(Terrain* terrain, EntityHandle planet, u32 seed) {
+    *terrain = (Terrain){
+        .seed = seed,
+        .amplitude = TERRAIN_AMPLITUDE,
+        .frequency = 2.0f,
+        .planet = planet,
+        .nodes = mrw_alloc_n(memory.stable, TerrainNode, TERRAIN_MAX_NODES),
+        .free_blocks = mrw_alloc_n(memory.stable, u32, TERRAIN_MAX_NODES / 4),
+        .jobs = mrw_alloc_n(memory.stable, TerrainJob, TERRAIN_N_JOBS),
+    };
+    memset(terrain->nodes, 0, sizeof(TerrainNode) * TERRAIN_MAX_NODES);
+    for (u32 i = 0; i < TERRAIN_N_JOBS; i++) {
+        atomic_init(&terrain->jobs[i].state, TJ_Free);
+        terrain->jobs[i].terrain = terrain;
+    }
+
+    terrain_init_indices();
+
+    for (u8 face = 0; face < 6; face++) {
+        terrain_node_init(terrain, face, TERRAIN_NO_NODE, face, 0, 0, 0);
+    }
+    terrain->n_nodes = 6;
+}
+
+// chunk jobs point into the terrain, they have to be done before it goes away
+void terrain_shutdown(Terrain* terrain) {
+    job_wait(&terrain->chunks);
+}
+
+// returns false when every job slot is taken, the node is asked for again next frame
+static bool terrain_request(Terrain* terrain, u32 n) {
+    TerrainNode* node = &terrain->nodes[n];
+    bool queued = false;
+
+    for (u32 i = 0; i < TERRAIN_N_JOBS && !queued; i++) {
+        TerrainJob* job = &terrain->jobs[i];
+        if (atomic_load_explicit(&job->state, memory_order_acquire) != TJ_Free) continue;
+
+        job->node = n;
+        job->generation = node->generation;
+        job->face = node->face;
+        job->depth = node->depth;
+        job->x = node->x;
+        job->y = node->y;
+        atomic_store_explicit(&job->state, TJ_Queued, memory_order_relaxed);
+        jobs_push((Job){
+            .name = "terrain_chunk_job",
+            .fn = terrain_chunk_job,
+            .data = job,
+            .end = 1,
+            .counter = &terrain->chunks,
+        });
+        queued = true;
+    }
+
+    node->queued = queued;
+    return queued;
+}
+
+static void terrain_chunk_ready(Terrain* terrain, Scene* scene, TerrainJob* job) {
+    TerrainNode* node = &terrain->nodes[job->node];
+    node->queued = false;
+    node->has_mesh = true;
+    node->mesh = render_mesh_create_shared(slice_u8_arr(job->vertices), slice_u8_arr(terrain_indices), entity_mesh(scene, terrain->planet)->mesh);
+    render_mesh_set_hidden(node->mesh, true);
+}
+
+static void terrain_collect(Terrain* terrain, Scene* scene) {
+    for (u32 i = 0; i < TERRAIN_N_JOBS; i++) {
+        TerrainJob* job = &terrain->jobs[i];
+        if (atomic_load_explicit(&job->state, memory_order_acquire) != TJ_Done) continue;
+
+        if (terrain->nodes[job->node].generation == job->generation) {
+            terrain_chunk_ready(terrain, scene, job);
+        }
+        atomic_store_explicit(&job->state, TJ_Free, memory_order_relaxed);
+    }
+}
+
+static void terrain_set_visible(TerrainNode* node, bool visible) {
+    if (!node->has_mesh || node->visible == visible) return;
+    node->visible = visible;
+    render_mesh_set_hidden(node->mesh, !visible);
+}
+
+static void terrain_free_children(Terrain* terrain, u32 n) {
+    TerrainNode* node = &terrain->nodes[n];
+    if (node->children == TERRAIN_NO_NODE) return;
+
+    for (u32 c = 0; c < 4; c++) {
+        u32 child_index = node->children + c;
+        terrain_free_children(terrain, child_index);
+
+        TerrainNode* child = &terrain->nodes[child_index];
+        if (child->has_mesh) {
+            render_mesh_free(child->mesh);
+        }
+        child->generation++;
+        child->has_mesh = false;
+        child->queued = false;
+    }
+
+    terrain->free_blocks[terrain->n_free_blocks++] = node->children;
+    node->children = TERRAIN_NO_NODE;
+}
+
+static bool terrain_split(Terrain* terrain, u32 n) {
+    u32 block;
+    if (terrain->n_free_blocks) {
+        block = terrain->free_blocks[--terrain->n_free_blocks];
+    }
+    else if (terrain->n_nodes + 4 <= TERRAIN_MAX_NODES) {
+        block = terrain->n_nodes;
+        terrain->n_nodes += 4;
+    }
+    else {
+        return false;
+    }
+
+    TerrainNode* node = &terrain->nodes[n];
+    node->children = block;
+    for (u32 c = 0; c < 4; c++) {
+        terrain_node_init(terrain, block + c, n, node->face, node->depth + 1, node->x * 2 + (c & 1), node->y * 2 + (c >> 1));
+    }
+    return true;
+}
+
+// splits and merges, returns whether the node's area can be drawn from it or its children
+static bool terrain_update_node(Terrain* terrain, u32 n, vec3s camera) {
+    TerrainNode* node = &terrain->nodes[n];
+    if (!node->has_mesh && !node->queued) {
+        terrain_request(terrain, n);
+    }
+
+    f32 distance = vec3_distance(camera, node->center);
+    f32 split_distance = node->size * TERRAIN_SPLIT_DISTANCE;
+
+    if (node->children == TERRAIN_NO_NODE) {
+        if (node->has_mesh && node->depth < TERRAIN_MAX_DEPTH && distance < split_distance) {
+            terrain_split(terrain, n);
+        }
+    }
+    else if (distance > split_distance * TERRAIN_MERGE_HYSTERESIS) {
+        terrain_free_children(terrain, n);
+    }
+
+    node = &terrain->nodes[n];
+    bool children_ready = node->children != TERRAIN_NO_NODE;
+    if (children_ready) {
+        u32 children = node->children;
+        for (u32 c = 0; c < 4; c++) {
+            children_ready &= terrain_update_node(terrain, children + c, camera);
+        }
+        node = &terrain->nodes[n];
+    }
+
+    node->children_ready = children_ready;
+    return node->has_mesh || children_ready;
+}
+
+// a node is drawn when nothing above it is and its children can't replace it yet
+static void terrain_show_node(Terrain* terrain, u32 n, bool covered) {
+    TerrainNode* node = &terrain->nodes[n];
+    bool drawn = !covered && !node->children_ready;
+    terrain_set_visible(node, drawn);
+
+    if (node->children != TERRAIN_NO_NODE) {
+        for (u32 c = 0; c < 4; c++) {
+            terrain_show_node(terrain, node->children + c, covered || drawn);
+        }
+    }
+}
+
+void terrain_update(Terrain* terrain, Scene* scene, EntityHandle camera) {
+    PROFILE_BEGIN("terrain_update");
+
+    terrain_collect(terrain, scene);
+
+    struct TransformC* planet = entity_transform(scene, terrain->planet);
+    struct TransformC* eye = entity_transform(scene, camera);
+    if (planet && eye) {
+        vec3s local = transform_calculate_local(planet->world, eye->world).pos;
+        for (u32 face = 0; face < 6; face++) {
+            terrain_update_node(terrain, face, local);
+            terrain_show_node(terrain, face, false);
+        }
+    }
+
+    PROFILE_END();
+}
+
+// ground radius in world units under a world space position, for planets
+// without terrain that's just their scale
+f32 planet_ground_radius(Scene* scene, EntityHandle planet, vec3s pos) {
+    struct Transform* world = &entity_transform(scene, planet)->world;
+    Terrain* terrain = entity_planet(scene, planet)->terrain;
+    if (!terrain) return world->scale;
+
+    vec3s dir = vec3_normalize(quat_rotatev(quat_inv(world->rot), vec3_sub(pos, world->pos)));
+    return terrain_height(terrain, dir) * world->scale;
+}
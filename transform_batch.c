@@ -0,0 +1,173 @@
+#define FLOS_TRANSFORM_BATCH
+#include "base.c"
+
+// batched world transform + instance matrix kernel. takes a list of slots in a
+// transform column and their parents' slots, computes world = parent * local
+// and _matrix in one go, 4 entities at a time when sse is available
+//
+// parents of everything in one call have to be final already, the scene calls
+// this once per depth level. rotations are assumed to be unit quaternions
+//
+// lanes are gathered from the TransformC column and scattered back. a level's
+// slots are in creation order, not next to each other, so soa columns would
+// gather too, one cache line per field instead of a few per entity. avx only
+// doubles the lanes of the math, the gathers stay the same
+
+#define TRANSFORM_NO_PARENT 0xFFFFFFFFu
+
+#if defined(__SSE2__) && !defined(FLOS_TRANSFORM_SCALAR)
+#include <immintrin.h>
+#define TRANSFORM_BATCH_SIMD
+#endif
+
+void transform_world_scalar(struct TransformC* transforms, const u32* indices, const u32* parents, u32 n) {
+    for (u32 i = 0; i < n; i++) {
+        struct TransformC* transform = &transforms[indices[i]];
+        transform->world = parents[i] != TRANSFORM_NO_PARENT
+            ? transform_calculate_world(transforms[parents[i]].world, transform->local)
+            : transform->local;
+        transform->_matrix = mat4_from_transform(&transform->world);
+    }
+}
+
+#ifdef TRANSFORM_BATCH_SIMD
+
+// one transform per lane
+STRUCT(TransformLanes) {
+    __m128 px, py, pz;
+    __m128 qx, qy, qz, qw;
+    __m128 s;
+};
+
+static const struct Transform transform_identity = { .rot = { .w = 1.0f }, .scale = 1.0f };
+
+static inline TransformLanes transform_lanes_load(const struct Transform* t[4]) {
+    return (TransformLanes){
+        .px = _mm_setr_ps(t[0]->pos.x, t[1]->pos.x, t[2]->pos.x, t[3]->pos.x),
+        .py = _mm_setr_ps(t[0]->pos.y, t[1]->pos.y, t[2]->pos.y, t[3]->pos.y),
+        .pz = _mm_setr_ps(t[0]->pos.z, t[1]->pos.z, t[2]->pos.z, t[3]->pos.z),
+        .qx = _mm_setr_ps(t[0]->rot.x, t[1]->rot.x, t[2]->rot.x, t[3]->rot.x),
+        .qy = _mm_setr_ps(t[0]->rot.y, t[1]->rot.y, t[2]->rot.y, t[3]->rot.y),
+        .qz = _mm_setr_ps(t[0]->rot.z, t[1]->rot.z, t[2]->rot.z, t[3]->rot.z),
+        .qw = _mm_setr_ps(t[0]->rot.w, t[1]->rot.w, t[2]->rot.w, t[3]->rot.w),
+        .s  = _mm_setr_ps(t[0]->scale, t[1]->scale, t[2]->scale, t[3]->scale),
+    };
+}
+
+static inline TransformLanes transform_lanes_world(TransformLanes p, TransformLanes l) {
+    TransformLanes w;
+
+    // v = local.pos * parent.scale, rotated by parent.rot:
+    // t = 2 * cross(q, v), v' = v + q.w * t + cross(q, t)
+    __m128 two = _mm_set1_ps(2.0f);
+    __m128 vx = _mm_mul_ps(l.px, p.s);
+    __m128 vy = _mm_mul_ps(l.py, p.s);
+    __m128 vz = _mm_mul_ps(l.pz, p.s);
+
+    __m128 tx = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(p.qy, vz), _mm_mul_ps(p.qz, vy)));
+    __m128 ty = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(p.qz, vx), _mm_mul_ps(p.qx, vz)));
+    __m128 tz = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(p.qx, vy), _mm_mul_ps(p.qy, vx)));
+
+    w.px = _mm_add_ps(p.px, _mm_add_ps(vx, _mm_add_ps(_mm_mul_ps(p.qw, tx), _mm_sub_ps(_mm_mul_ps(p.qy, tz), _mm_mul_ps(p.qz, ty)))));
+    w.py = _mm_add_ps(p.py, _mm_add_ps(vy, _mm_add_ps(_mm_mul_ps(p.qw, ty), _mm_sub_ps(_mm_mul_ps(p.qz, tx), _mm_mul_ps(p.qx, tz)))));
+    w.pz = _mm_add_ps(p.pz, _mm_add_ps(vz, _mm_add_ps(_mm_mul_ps(p.qw, tz), _mm_sub_ps(_mm_mul_ps(p.qx, ty), _mm_mul_ps(p.qy, tx)))));
+
+    // parent.rot * local.rot
+    w.qw = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(p.qw, l.qw), _mm_mul_ps(p.qx, l.qx)), _mm_add_ps(_mm_mul_ps(p.qy, l.qy), _mm_mul_ps(p.qz, l.qz)));
+    w.qx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p.qw, l.qx), _mm_mul_ps(p.qx, l.qw)), _mm_sub_ps(_mm_mul_ps(p.qy, l.qz), _mm_mul_ps(p.qz, l.qy)));
+    w.qy = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(p.qw, l.qy), _mm_mul_ps(p.qx, l.qz)), _mm_add_ps(_mm_mul_ps(p.qy, l.qw), _mm_mul_ps(p.qz, l.qx)));
+    w.qz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p.qw, l.qz), _mm_mul_ps(p.qx, l.qy)), _mm_sub_ps(_mm_mul_ps(p.qz, l.qw), _mm_mul_ps(p.qy, l.qx)));
+
+    w.s = _mm_mul_ps(p.s, l.s);
+    return w;
+}
+
+static inline void transform_lanes_store(TransformLanes w, struct TransformC* out[4]) {
+    // same layout as quat_mat4, scaled, column major
+    __m128 two = _mm_set1_ps(2.0f);
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 xx = _mm_mul_ps(two, _mm_mul_ps(w.qx, w.qx));
+    __m128 yy = _mm_mul_ps(two, _mm_mul_ps(w.qy, w.qy));
+    __m128 zz = _mm_mul_ps(two, _mm_mul_ps(w.qz, w.qz));
+    __m128 xy = _mm_mul_ps(two, _mm_mul_ps(w.qx, w.qy));
+    __m128 yz = _mm_mul_ps(two, _mm_mul_ps(w.qy, w.qz));
+    __m128 xz = _mm_mul_ps(two, _mm_mul_ps(w.qx, w.qz));
+    __m128 wx = _mm_mul_ps(two, _mm_mul_ps(w.qw, w.qx));
+    __m128 wy = _mm_mul_ps(two, _mm_mul_ps(w.qw, w.qy));
+    __m128 wz = _mm_mul_ps(two, _mm_mul_ps(w.qw, w.qz));
+
+    __m128 c0x = _mm_mul_ps(w.s, _mm_sub_ps(one, _mm_add_ps(yy, zz)));
+    __m128 c0y = _mm_mul_ps(w.s, _mm_add_ps(xy, wz));
+    __m128 c0z = _mm_mul_ps(w.s, _mm_sub_ps(xz, wy));
+    __m128 c0w = _mm_setzero_ps();
+
+    __m128 c1x = _mm_mul_ps(w.s, _mm_sub_ps(xy, wz));
+    __m128 c1y = _mm_mul_ps(w.s, _mm_sub_ps(one, _mm_add_ps(xx, zz)));
+    __m128 c1z = _mm_mul_ps(w.s, _mm_add_ps(yz, wx));
+    __m128 c1w = _mm_setzero_ps();
+
+    __m128 c2x = _mm_mul_ps(w.s, _mm_add_ps(xz, wy));
+    __m128 c2y = _mm_mul_ps(w.s, _mm_sub_ps(yz, wx));
+    __m128 c2z = _mm_mul_ps(w.s, _mm_sub_ps(one, _mm_add_ps(xx, yy)));
+    __m128 c2w = _mm_setzero_ps();
+
+    __m128 c3x = w.px;
+    __m128 c3y = w.py;
+    __m128 c3z = w.pz;
+    __m128 c3w = one;
+
+    _MM_TRANSPOSE4_PS(c0x, c0y, c0z, c0w);
+    _MM_TRANSPOSE4_PS(c1x, c1y, c1z, c1w);
+    _MM_TRANSPOSE4_PS(c2x, c2y, c2z, c2w);
+    _MM_TRANSPOSE4_PS(c3x, c3y, c3z, c3w);
+
+    // after the transposes cNx..cNw hold column N of lanes 0..3
+    __m128 cols[4][4] = {
+        { c0x, c1x, c2x, c3x },
+        { c0y, c1y, c2y, c3y },
+        { c0z, c1z, c2z, c3z },
+        { c0w, c1w, c2w, c3w },
+    };
+
+    _Alignas(16) f32 px[4], py[4], pz[4], qx[4], qy[4], qz[4], qw[4], s[4];
+    _mm_store_ps(px, w.px); _mm_store_ps(py, w.py); _mm_store_ps(pz, w.pz);
+    _mm_store_ps(qx, w.qx); _mm_store_ps(qy, w.qy); _mm_store_ps(qz, w.qz); _mm_store_ps(qw, w.qw);
+    _mm_store_ps(s, w.s);
+
+    for (u32 k = 0; k < 4; k++) {
+        struct TransformC* t = out[k];
+        t->world.pos = (vec3s){ .x = px[k], .y = py[k], .z = pz[k] };
+        t->world.rot = (quats){ .x = qx[k], .y = qy[k], .z = qz[k], .w = qw[k] };
+        t->world.scale = s[k];
+        for (u32 c = 0; c < 4; c++) {
+            _mm_storeu_ps(t->_matrix.col[c].raw, cols[k][c]);
+        }
+    }
+}
+
+void transform_world_batch(struct TransformC* transforms, const u32* indices, const u32* parents, u32 n) {
+    u32 i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const struct Transform* parent[4];
+        const struct Transform* local[4];
+        struct TransformC* out[4];
+        for (u32 k = 0; k < 4; k++) {
+            out[k] = &transforms[indices[i + k]];
+            local[k] = &out[k]->local;
+            parent[k] = parents[i + k] != TRANSFORM_NO_PARENT ? &transforms[parents[i + k]].world : &transform_identity;
+        }
+
+        TransformLanes world = transform_lanes_world(transform_lanes_load(parent), transform_lanes_load(local));
+        transform_lanes_store(world, out);
+    }
+
+    transform_world_scalar(transforms, indices + i, parents + i, n - i);
+}
+
+#else // TRANSFORM_BATCH_SIMD
+
+void transform_world_batch(struct TransformC* transforms, const u32* indices, const u32* parents, u32 n) {
+    transform_world_scalar(transforms, indices, parents, n);
+}
+
+#endif // TRANSFORM_BATCH_SIMD
@@ -1,8 +1,45 @@
 #define FLOS_UTILS
 #include "base.c"
 
+// pcg32, small enough to carry one per plant and seedable so headless runs are
+// reproducible
+STRUCT(Rng) {
+    u64 state;
+    u64 inc;
+};
+
+u32 rng_u32(Rng* rng) {
+    u64 old = rng->state;
+    rng->state = old * 6364136223846793005ULL + rng->inc;
+    u32 xorshifted = (u32)(((old >> 18u) ^ old) >> 27u);
+    u32 rot = (u32)(old >> 59u);
+    return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+Rng rng_seeded(u64 seed) {
+    Rng rng = { .state = 0, .inc = (seed << 1u) | 1u };
+    rng_u32(&rng);
+    rng.state += seed;
+    rng_u32(&rng);
+    return rng;
+}
+
+f32 rng_f32(Rng* rng, f32 min, f32 max) {
+    return min + (max - min) * ((f32)(rng_u32(rng) >> 8) * (1.0f / 16777216.0f));
+}
+
+Rng random_rng = { .state = 0x853c49e6748fea9bULL, .inc = 0xda3e39cb94b95bdbULL };
+
+void random_seed(u64 seed) {
+    random_rng = rng_seeded(seed);
+}
+
+f32 random_f32(f32 min, f32 max) {
+    return rng_f32(&random_rng, min, max);
+}
+
 static float random_gaussian(void) {
-    return sqrtf(-2.0f * logf(mrw_random_f32(0.0001, 1.0f))) * cosf(2.0f * (float)M_PI * mrw_random());
+    return sqrtf(-2.0f * logf(random_f32(0.0001, 1.0f))) * cosf(2.0f * (float)M_PI * random_f32(0.0f, 1.0f));
 }
 
 vec3s random_on_sphere(void) {
@@ -12,3 +49,39 @@ vec3s random_on_sphere(void) {
         .z = random_gaussian(),
     });
 }
+
+f64 time_now(void) {
+#if defined(__EMSCRIPTEN__)
+    return emscripten_get_now() * 0.001;
+#elif defined(FLOS_HEADLESS)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (f64)ts.tv_sec + (f64)ts.tv_nsec * 1e-9;
+#else
+    return glfwGetTime();
+#endif
+}
+
+// whole file, empty if it can't be read
+str file_read(cstr path, Allocator* allocator) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return (str){ 0 };
+    fseek(fp, 0, SEEK_END);
+    usize size = ftell(fp);
+    rewind(fp);
+    char* buf = mrw_alloc_n(allocator, char, max(size, (usize)1));
+    size = fread(buf, 1, size, fp);
+    fclose(fp);
+    return slice_to(buf, size);
+}
+
+#define HASH_INIT 0xcbf29ce484222325ull
+
+// fnv-1a, chain calls to hash several buffers into one
+u64 hash_bytes(u64 hash, const void* data, usize size) {
+    const u8* bytes = data;
+    for (usize i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
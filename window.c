@@ -142,7 +142,9 @@ void window_init(void)
     window.width = 800;
     window.height = 800;
 
-#ifdef __EMSCRIPTEN__
+#if defined(FLOS_HEADLESS)
+    window.window = nullptr;
+#elif defined(__EMSCRIPTEN__)
     window.window = "#canvas";
     emscripten_set_mousemove_callback(window.window, &renderer.ripple_context, EM_TRUE, on_mouse);
     emscripten_set_mousedown_callback(window.window, &renderer.ripple_context, EM_TRUE, on_mouse);
@@ -162,7 +164,7 @@ void window_init(void)
 }
 
 void window_update_input(Allocator* allocator) {
-#ifndef __EMSCRIPTEN__
+#if !defined(__EMSCRIPTEN__) && !defined(FLOS_HEADLESS)
     if (window.keys[KEY_PRESSED][KEY_ESC]) {
         window.mouse.has_lock = false;
         glfwSetInputMode(window.window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
@@ -178,6 +180,7 @@ void window_update_input(Allocator* allocator) {
         window.keys[KEY_RELEASED][i] = false;
     }
 
+#ifndef FLOS_HEADLESS
     if (!CURSOR().consumed && CURSOR().left.pressed) {
     #ifdef __EMSCRIPTEN__
         emscripten_request_pointerlock("#canvas", EM_TRUE);
@@ -186,6 +189,7 @@ void window_update_input(Allocator* allocator) {
         window.mouse.has_lock = true;
     #endif
     }
+#endif // FLOS_HEADLESS
 
     // text(mrw_format("mousedxdy: {.2f} {.2f}", allocator,
     //     window.mouse.dx,